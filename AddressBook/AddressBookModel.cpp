@@ -1,4 +1,9 @@
 #include "AddressBookModel.hpp"
+#include "ReputationFetcher.hpp"
+#include <AsyncLog.hpp>
+#include <EventJournal.hpp>
+#include <IconProvider.hpp>
+#include <Trace.hpp>
 #include <QIcon>
 #include <QPixmap>
 #include <QImage>
@@ -8,10 +13,26 @@
 #include <fc/log/logger.hpp>
 #include <fc/io/raw.hpp>
 
+#include <algorithm>
+#include <unordered_set>
+
 
 
 const QIcon& Contact::getIcon() const {return icon; }
 
+Contact::Contact( const bts::addressbook::wallet_contact& contact, const QImage& decoded_icon )
+: bts::addressbook::wallet_contact(contact)
+{
+   if( !decoded_icon.isNull() )
+   {
+      icon = QIcon( QPixmap::fromImage(decoded_icon) );
+   }
+   else
+   {
+      icon = IconProvider::icon( ":/images/user.png" );
+   }
+}
+
 Contact::Contact( const bts::addressbook::wallet_contact& contact )
 : bts::addressbook::wallet_contact(contact)
 {
@@ -29,7 +50,7 @@ Contact::Contact( const bts::addressbook::wallet_contact& contact )
    }
    else
    {
-      icon.addFile(QStringLiteral(":/images/user.png"), QSize(), QIcon::Normal, QIcon::Off);
+      icon = IconProvider::icon( ":/images/user.png" );
    }
 }
 
@@ -75,35 +96,143 @@ namespace Detail
           std::vector<Contact>                    _contacts;
           bts::addressbook::addressbook_ptr       _address_book;
           QStringListModel                        _contact_completion_model;
+          /// dac id and full name of every contact to its wallet index
+          QHash<QString,int>                      _completion_index;
+          std::unique_ptr<ReputationFetcher>      _reputation_fetcher;
+          /// false until the contacts are in, anything stored before then is merged by setContacts()
+          bool                                    _loaded;
     };
 }
 
 
 
-AddressBookModel::AddressBookModel( QObject* parent, bts::addressbook::addressbook_ptr address_book )
+AddressBookModel::AddressBookModel( QObject* parent, bts::addressbook::addressbook_ptr address_book, bool load_contacts )
 :QAbstractTableModel(parent),my( new Detail::AddressBookModelImpl() )
 {
    my->_address_book = address_book;
-   my->_default_icon.addFile(QStringLiteral(":/images/user.png"), QSize(), QIcon::Normal, QIcon::Off);
+   my->_loaded = false;
+   my->_default_icon = IconProvider::icon( ":/images/user.png" );
+   my->_reputation_fetcher.reset( new ReputationFetcher( [=]( const std::vector<std::string>& updated_ids ){
+                                                            reputationBatchReady( updated_ids ); } ) );
+
+   if( load_contacts )
+   {
+      const std::unordered_map<uint32_t,bts::addressbook::wallet_contact>& loaded_contacts = address_book->get_contacts();
+      std::vector<bts::addressbook::wallet_contact> contacts;
+      contacts.reserve( loaded_contacts.size() );
+      for( auto itr = loaded_contacts.begin(); itr != loaded_contacts.end(); ++itr )
+      {
+         contacts.push_back( itr->second );
+      }
+      setContacts( loadContacts( contacts ) );
+   }
+}
 
-   const std::unordered_map<uint32_t,bts::addressbook::wallet_contact>& loaded_contacts = address_book->get_contacts();
-   my->_contacts.reserve( loaded_contacts.size() );
-   QStringList completion_list;
-   for( auto itr = loaded_contacts.begin(); itr != loaded_contacts.end(); ++itr )
+AddressBookModel::ContactsSnapshot AddressBookModel::loadContacts( const std::vector<bts::addressbook::wallet_contact>& contacts )
+{
+   ContactsSnapshot snapshot;
+   snapshot.contacts = contacts;
+   snapshot.icons.resize( contacts.size() );
+   KH_DLOG( "loading ${n} contacts", ("n",contacts.size()) );
+   for( uint32_t i = 0; i < contacts.size(); ++i )
    {
-      auto contact = itr->second;
-      ilog( "loading contacts..." );
-      my->_contacts.push_back( Contact(contact) );
+      const auto& contact = contacts[i];
+      if( contact.icon_png.size() &&
+          !snapshot.icons[i].loadFromData( (unsigned char*)contact.icon_png.data(), contact.icon_png.size() ) )
+      {
+         wlog( "unable to load icon for contact ${c}", ("c",contact) );
+      }
 
       //add dac_id to completion list
-      completion_list.push_back( contact.dac_id_string.c_str() );
+      snapshot.completions.push_back( contact.dac_id_string.c_str() );
       //add fullname to completion list
       QString fullName = contact.first_name.c_str();
       fullName += " ";
       fullName += contact.last_name.c_str();
-      completion_list.push_back(fullName);
+      snapshot.completions.push_back(fullName);
+   }
+   return snapshot;
+}
+
+namespace
+{
+   QStringList completionKeys( const bts::addressbook::wallet_contact& contact )
+   {
+      return QStringList() << contact.dac_id_string.c_str()
+                           << QString( "%1 %2" ).arg( contact.first_name.c_str() ).arg( contact.last_name.c_str() );
+   }
+
+   void indexCompletions( QHash<QString,int>& completion_index, const bts::addressbook::wallet_contact& contact )
+   {
+      // the first contact to claim a name keeps it, same as the completer's first match
+      foreach( const QString& key, completionKeys( contact ) )
+      {
+         if( !completion_index.contains( key ) )
+            completion_index.insert( key, contact.wallet_index );
+      }
+   }
+
+   /**
+    *  Drops the names previous_contact held that updated_contact no longer has,
+    *  handing each to the next contact with the same name if there is one.
+    */
+   void reindexCompletions( QHash<QString,int>& completion_index, const std::vector<Contact>& contacts,
+                            const bts::addressbook::wallet_contact& previous_contact,
+                            const bts::addressbook::wallet_contact& updated_contact )
+   {
+      QStringList kept_keys = completionKeys( updated_contact );
+      foreach( const QString& key, completionKeys( previous_contact ) )
+      {
+         if( kept_keys.contains( key ) || completion_index.value( key, -1 ) != previous_contact.wallet_index )
+            continue;
+         completion_index.remove( key );
+         for( auto itr = contacts.begin(); itr != contacts.end(); ++itr )
+         {
+            if( itr->wallet_index != previous_contact.wallet_index && completionKeys( *itr ).contains( key ) )
+            {
+               completion_index.insert( key, itr->wallet_index );
+               break;
+            }
+         }
+      }
+      indexCompletions( completion_index, updated_contact );
+   }
+}
+
+void AddressBookModel::setContacts( const ContactsSnapshot& snapshot )
+{
+   KH_TRACE_SCOPE( "AddressBookModel::setContacts" );
+   // contacts stored while the snapshot was loading are newer than what it holds
+   std::vector<Contact> stored_while_loading;
+   stored_while_loading.swap( my->_contacts );
+
+   QStringList completions = snapshot.completions;
+   beginResetModel();
+   my->_contacts.reserve( snapshot.contacts.size() + stored_while_loading.size() );
+   for( uint32_t i = 0; i < snapshot.contacts.size(); ++i )
+   {
+      my->_contacts.push_back( Contact( snapshot.contacts[i], snapshot.icons[i] ) );
+   }
+   for( auto itr = stored_while_loading.begin(); itr != stored_while_loading.end(); ++itr )
+   {
+      auto existing = std::find_if( my->_contacts.begin(), my->_contacts.end(),
+                                    [&]( const Contact& c ){ return c.wallet_index == itr->wallet_index; } );
+      if( existing != my->_contacts.end() )
+         *existing = *itr;
+      else
+         my->_contacts.push_back( *itr );
+      completions.push_back( itr->dac_id_string.c_str() );
+      completions.push_back( QString( "%1 %2" ).arg( itr->first_name.c_str() ).arg( itr->last_name.c_str() ) );
+   }
+   my->_loaded = true;
+   endResetModel();
+   my->_contact_completion_model.setStringList( completions );
+   my->_completion_index.clear();
+   my->_completion_index.reserve( int(my->_contacts.size()) * 2 );
+   for( auto itr = my->_contacts.begin(); itr != my->_contacts.end(); ++itr )
+   {
+      indexCompletions( my->_completion_index, *itr );
    }
-   my->_contact_completion_model.setStringList(completion_list);
 }
 
 AddressBookModel::~AddressBookModel()
@@ -207,14 +336,36 @@ QVariant AddressBookModel::data( const QModelIndex& index, int role )const
              case Id:
                  return current_contact.dac_id_string.c_str();
              case Age:
-                 return 0;
+             {
+                 auto reputation = my->_reputation_fetcher->get( current_contact.dac_id_string );
+                 return reputation ? reputation->age : 0;
+             }
              case Repute:
-                 return 0;
+             {
+                 auto reputation = my->_reputation_fetcher->get( current_contact.dac_id_string );
+                 return reputation ? reputation->repute : 0;
+             }
 
              case UserIcon:
              case NumColumns:
                 return QVariant();
           }
+       case SortRole:
+          switch( (Columns)index.column() )
+          {
+             case Age:
+             {
+                 auto reputation = my->_reputation_fetcher->peek( current_contact.dac_id_string );
+                 return reputation ? reputation->age : 0;
+             }
+             case Repute:
+             {
+                 auto reputation = my->_reputation_fetcher->peek( current_contact.dac_id_string );
+                 return reputation ? reputation->repute : 0;
+             }
+             default:
+                 return data( index, Qt::DisplayRole );
+          }
     }
     return QVariant();
 }
@@ -226,16 +377,40 @@ int AddressBookModel::storeContact( const Contact& contact_to_store )
        auto num_contacts = my->_contacts.size();
        beginInsertRows( QModelIndex(), num_contacts, num_contacts );
           my->_contacts.push_back(contact_to_store);
-          my->_contacts.back().wallet_index =  my->_contacts.size()-1;
+          // until setContacts() the rows are only what was stored meanwhile, the address book knows the next index
+          my->_contacts.back().wallet_index = my->_loaded ? my->_contacts.size()-1 : my->_address_book->get_contacts().size();
        endInsertRows();
        my->_address_book->store_contact( my->_contacts.back() );
+       EventJournal::instance().recordContactStored( my->_contacts.back() );
+       indexCompletions( my->_completion_index, my->_contacts.back() );
        return my->_contacts.back().wallet_index;
    }
 
-   FC_ASSERT( contact_to_store.wallet_index < int(my->_contacts.size()) );
-   auto row = contact_to_store.wallet_index;
+   int row = contact_to_store.wallet_index;
+   if( !my->_loaded )
+   {
+       auto existing = std::find_if( my->_contacts.begin(), my->_contacts.end(),
+                                     [&]( const Contact& c ){ return c.wallet_index == contact_to_store.wallet_index; } );
+       if( existing == my->_contacts.end() )
+       {
+           // a contact the snapshot still holds, setContacts() replaces it with this one
+           beginInsertRows( QModelIndex(), int(my->_contacts.size()), int(my->_contacts.size()) );
+              my->_contacts.push_back( contact_to_store );
+           endInsertRows();
+           existing = my->_contacts.end() - 1;
+       }
+       row = int( existing - my->_contacts.begin() );
+   }
+   FC_ASSERT( row < int(my->_contacts.size()) );
+   if( my->_contacts[row].dac_id_string != contact_to_store.dac_id_string )
+   {
+       my->_reputation_fetcher->invalidate( my->_contacts[row].dac_id_string );
+   }
+   Contact previous_contact = my->_contacts[row];
    my->_contacts[row] = contact_to_store;
    my->_address_book->store_contact(  my->_contacts[row]  );
+   EventJournal::instance().recordContactStored( my->_contacts[row] );
+   reindexCompletions( my->_completion_index, my->_contacts, previous_contact, my->_contacts[row] );
 
    Q_EMIT dataChanged( index( row, 0 ), index( row, NumColumns - 1) );
    return contact_to_store.wallet_index;
@@ -259,7 +434,31 @@ const Contact& AddressBookModel::getContact( const QModelIndex& index  )
    return my->_contacts[index.row()];
 }
 
+int AddressBookModel::findContactIdByCompletion( const QString& completion )const
+{
+   return my->_completion_index.value( completion, -1 );
+}
+
 QStringListModel* AddressBookModel::GetContactCompletionModel()
 {
   return &(my->_contact_completion_model);
-}
\ No newline at end of file
+}
+
+void AddressBookModel::reputationBatchReady( const std::vector<std::string>& updated_ids )
+{
+   std::unordered_set<std::string> updated( updated_ids.begin(), updated_ids.end() );
+   int first_row = -1;
+   int last_row  = -1;
+   for( uint32_t i = 0; i < my->_contacts.size(); ++i )
+   {
+      if( updated.count( my->_contacts[i].dac_id_string ) )
+      {
+         if( first_row == -1 ) first_row = i;
+         last_row = i;
+      }
+   }
+   if( first_row != -1 )
+   {
+      Q_EMIT dataChanged( index( first_row, Age ), index( last_row, Repute ) );
+   }
+}
@@ -9,9 +9,28 @@ namespace Detail { class AddressBookModelImpl; }
 class AddressBookModel : public QAbstractTableModel
 {
   public:
-    AddressBookModel( QObject* parent, bts::addressbook::addressbook_ptr address_book );
+    /**
+     *  Contacts copied out of the address book with their icons decoded and the
+     *  completion strings built.  Loading one touches no GUI objects so it can
+     *  be done on a worker thread and swapped in with setContacts().
+     */
+    struct ContactsSnapshot
+    {
+        std::vector<bts::addressbook::wallet_contact> contacts;
+        std::vector<QImage>                           icons;
+        QStringList                                   completions;
+    };
+
+    /**
+     *  @param load_contacts when false the model starts empty and is expected
+     *         to be filled by setContacts()
+     */
+    AddressBookModel( QObject* parent, bts::addressbook::addressbook_ptr address_book, bool load_contacts = true );
     ~AddressBookModel();
 
+    static ContactsSnapshot loadContacts( const std::vector<bts::addressbook::wallet_contact>& contacts );
+    void                    setContacts( const ContactsSnapshot& snapshot );
+
     enum Columns
     {
         UserIcon,
@@ -22,6 +41,9 @@ class AddressBookModel : public QAbstractTableModel
         Repute,
         NumColumns
     };
+
+    /** like Qt::DisplayRole but never starts a reputation fetch, sorting asks for every row */
+    enum { SortRole = Qt::UserRole };
     //void storeContact( const bts::addressbook::contact& new_contact );
 
     /**
@@ -40,7 +62,11 @@ class AddressBookModel : public QAbstractTableModel
     virtual QVariant data( const QModelIndex& index, int role = Qt::DisplayRole )const;
 
     QStringListModel* GetContactCompletionModel();
+    /** @return the id of the contact a completion string names, -1 if none does */
+    int               findContactIdByCompletion( const QString& completion )const;
 
   private:
+     void reputationBatchReady( const std::vector<std::string>& updated_ids );
+
      std::unique_ptr<Detail::AddressBookModelImpl> my;
 };
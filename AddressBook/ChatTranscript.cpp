@@ -0,0 +1,350 @@
+#include "ChatTranscript.hpp"
+
+#include <QColor>
+#include <QDir>
+#include <QtEndian>
+
+#include <fc/crypto/aes.hpp>
+#include <fc/crypto/rand.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+
+#include <unordered_map>
+
+namespace
+{
+   QString     gTranscriptDirectory;
+   fc::sha512  gTranscriptKey;
+   bool        gHaveTranscriptKey = false;
+
+   /// every holder of a contact's transcript shares one instance so the line index stays consistent
+   std::unordered_map< std::string, std::weak_ptr<ChatTranscript> > gOpenTranscripts;
+
+   // file layout: FileMagic, then records, little endian:
+   //    uint32 sealed_size | sealed payload
+   // the payload is AES encrypted after a random block, so equal lines never encrypt alike:
+   //    16 random bytes | int64 msecs | uint8 flags | uint32 from_size | from | msg
+   const char    FileMagic[]       = { 'K', 'H', 'C', '1' };
+   const quint32 FileHeaderSize    = sizeof(FileMagic);
+   const quint32 RecordHeaderSize  = 4;
+   const quint32 NonceSize         = 16;
+   const quint32 PayloadFixedSize  = 8 + 1 + 4;
+   const quint32 AesBlockSize      = 16;
+   const quint8  FromMeFlag        = 0x01;
+
+   QByteArray encodePayload( const ChatTranscript::Entry& new_entry )
+   {
+      QByteArray from = new_entry.from.toUtf8();
+      QByteArray msg  = new_entry.msg.toUtf8();
+      QByteArray payload( NonceSize + PayloadFixedSize, 0 );
+      fc::rand_bytes( payload.data(), NonceSize );
+      uchar* fixed = reinterpret_cast<uchar*>( payload.data() + NonceSize );
+      qToLittleEndian<qint64>( new_entry.time.toMSecsSinceEpoch(), fixed );
+      fixed[8] = new_entry.from_me ? FromMeFlag : 0;
+      qToLittleEndian<quint32>( from.size(), fixed + 9 );
+      payload.append( from );
+      payload.append( msg );
+      return payload;
+   }
+
+   /** payload is the part after the nonce */
+   ChatTranscript::Entry decodePayload( const uchar* payload, quint32 payload_size )
+   {
+      ChatTranscript::Entry result;
+      if( payload_size < PayloadFixedSize )
+         return result;
+      qint64  msecs     = qFromLittleEndian<qint64>( payload );
+      quint8  flags     = payload[8];
+      quint32 from_size = qFromLittleEndian<quint32>( payload + 9 );
+      from_size = qMin( from_size, payload_size - PayloadFixedSize );
+
+      const char* from_data = reinterpret_cast<const char*>( payload + PayloadFixedSize );
+      result.from    = QString::fromUtf8( from_data, from_size );
+      result.msg     = QString::fromUtf8( from_data + from_size, payload_size - PayloadFixedSize - from_size );
+      result.time    = QDateTime::fromMSecsSinceEpoch( msecs );
+      result.from_me = (flags & FromMeFlag) != 0;
+      return result;
+   }
+}
+
+ChatTranscript::ChatTranscript()
+:_map(nullptr),_mapped_size(0),_file_size(0)
+{
+}
+
+ChatTranscript::~ChatTranscript()
+{
+   close();
+}
+
+void ChatTranscript::setStorageDirectory( const QString& dir )
+{
+   gTranscriptDirectory = dir;
+}
+
+QString ChatTranscript::storageDirectory()
+{
+   return gTranscriptDirectory;
+}
+
+void ChatTranscript::setStorageKey( const fc::sha512& key )
+{
+   gTranscriptKey     = key;
+   gHaveTranscriptKey = true;
+}
+
+std::shared_ptr<ChatTranscript> ChatTranscript::openForContact( const std::string& dac_id )
+{
+   if( dac_id.empty() || gTranscriptDirectory.isEmpty() || !gHaveTranscriptKey )
+      return ChatTranscriptPtr();
+
+   auto itr = gOpenTranscripts.find( dac_id );
+   if( itr != gOpenTranscripts.end() )
+   {
+      if( auto shared = itr->second.lock() )
+         return shared;
+   }
+
+   QDir().mkpath( gTranscriptDirectory );
+   QString base_name = QString::fromLatin1( QByteArray( dac_id.c_str(), int(dac_id.size()) ).toHex() );
+   auto transcript = std::make_shared<ChatTranscript>();
+   if( !transcript->open( QDir(gTranscriptDirectory).filePath( base_name + ".kct" ) ) )
+      return ChatTranscriptPtr();
+   gOpenTranscripts[dac_id] = transcript;
+   return transcript;
+}
+
+bool ChatTranscript::open( const QString& file_path )
+{
+   close();
+   _file.setFileName( file_path );
+   if( !_file.open( QIODevice::ReadWrite ) )
+   {
+      wlog( "unable to open chat transcript ${f}", ("f",file_path.toStdString()) );
+      return false;
+   }
+   _file_size = _file.size();
+   if( _file_size < FileHeaderSize )
+   {
+      _file.resize( 0 );
+      _file.write( FileMagic, FileHeaderSize );
+      _file.flush();
+      _file_size = FileHeaderSize;
+   }
+   else if( _file.read( FileHeaderSize ) != QByteArray( FileMagic, FileHeaderSize ) )
+   {
+      wlog( "${f} is not a chat transcript", ("f",file_path.toStdString()) );
+      _file.close();
+      return false;
+   }
+
+   // index the existing lines, dropping a partially written tail record
+   qint64 offset = FileHeaderSize;
+   if( _file_size > offset && ensureMapped( _file_size ) )
+   {
+      while( offset + RecordHeaderSize <= _file_size )
+      {
+         quint32 sealed_size = qFromLittleEndian<quint32>( _map + offset );
+         qint64  record_end  = offset + RecordHeaderSize + sealed_size;
+         if( sealed_size < NonceSize + PayloadFixedSize || sealed_size % AesBlockSize || record_end > _file_size )
+            break;
+         _offsets.push_back( offset );
+         offset = record_end;
+      }
+   }
+   if( offset != _file_size )
+   {
+      wlog( "truncating damaged chat transcript ${f} at ${o}", ("f",file_path.toStdString())("o",offset) );
+      if( _map )
+      {
+         _file.unmap( _map );
+         _map = nullptr;
+         _mapped_size = 0;
+      }
+      _file.resize( offset );
+      _file_size = offset;
+   }
+   return true;
+}
+
+void ChatTranscript::close()
+{
+   if( _map )
+   {
+      _file.unmap( _map );
+      _map = nullptr;
+   }
+   _mapped_size = 0;
+   _file_size = 0;
+   _offsets.clear();
+   _file.close();
+}
+
+bool ChatTranscript::isOpen()const
+{
+   return _file.isOpen();
+}
+
+bool ChatTranscript::ensureMapped( quint64 end_offset )const
+{
+   if( _map && qint64(end_offset) <= _mapped_size )
+      return true;
+   if( _map )
+   {
+      _file.unmap( _map );
+      _map = nullptr;
+      _mapped_size = 0;
+   }
+   qint64 file_size = _file.size();
+   if( file_size == 0 )
+      return false;
+   _map = _file.map( 0, file_size );
+   if( !_map )
+   {
+      wlog( "unable to map chat transcript ${f}", ("f",_file.fileName().toStdString()) );
+      return false;
+   }
+   _mapped_size = file_size;
+   return qint64(end_offset) <= _mapped_size;
+}
+
+int ChatTranscript::size()const
+{
+   return int(_offsets.size());
+}
+
+ChatTranscript::Entry ChatTranscript::entry( int line )const
+{
+   Entry result;
+   if( line < 0 || line >= size() )
+      return result;
+
+   quint64 offset = _offsets[line];
+   quint64 end    = (line + 1 < size()) ? _offsets[line+1] : quint64(_file_size);
+   if( !ensureMapped( end ) )
+      return result;
+
+   const char* record      = reinterpret_cast<const char*>( _map + offset );
+   quint32     sealed_size = qFromLittleEndian<quint32>( _map + offset );
+   try {
+      std::vector<char> sealed( record + RecordHeaderSize, record + RecordHeaderSize + sealed_size );
+      std::vector<char> payload = fc::aes_decrypt( gTranscriptKey, sealed );
+      if( payload.size() < NonceSize )
+         return result;
+      return decodePayload( reinterpret_cast<const uchar*>( payload.data() ) + NonceSize,
+                            quint32( payload.size() - NonceSize ) );
+   }
+   catch ( const fc::exception& e )
+   {
+      wlog( "unable to decrypt line ${l} of ${f}: ${e}", ("l",line)("f",_file.fileName().toStdString())("e",e.to_string()) );
+   }
+   return result;
+}
+
+void ChatTranscript::appendRecord( QByteArray& buffer, const Entry& new_entry )
+{
+   QByteArray        payload = encodePayload( new_entry );
+   std::vector<char> sealed  = fc::aes_encrypt( gTranscriptKey, std::vector<char>( payload.begin(), payload.end() ) );
+
+   int start = buffer.size();
+   buffer.resize( start + RecordHeaderSize );
+   qToLittleEndian<quint32>( quint32( sealed.size() ), reinterpret_cast<uchar*>( buffer.data() + start ) );
+   buffer.append( sealed.data(), int( sealed.size() ) );
+
+   _offsets.push_back( _file_size + start );
+}
+
+void ChatTranscript::append( const Entry& new_entry )
+{
+   append( std::vector<Entry>( 1, new_entry ) );
+}
+
+void ChatTranscript::append( const std::vector<Entry>& new_entries )
+{
+   if( !_file.isOpen() || new_entries.empty() )
+      return;
+
+   QByteArray buffer;
+   for( auto itr = new_entries.begin(); itr != new_entries.end(); ++itr )
+   {
+      appendRecord( buffer, *itr );
+   }
+
+   _file.seek( _file_size );
+   if( _file.write( buffer ) != buffer.size() )
+   {
+      wlog( "error appending to chat transcript ${f}", ("f",_file.fileName().toStdString()) );
+   }
+   _file.flush();
+   _file_size += buffer.size();
+}
+
+
+ChatTranscriptModel::ChatTranscriptModel( QObject* parent )
+:QAbstractListModel(parent),_cached_row(-1)
+{
+}
+
+ChatTranscriptModel::~ChatTranscriptModel()
+{
+}
+
+void ChatTranscriptModel::setTranscript( const ChatTranscriptPtr& transcript )
+{
+   beginResetModel();
+   _transcript = transcript;
+   _cached_row = -1;
+   endResetModel();
+}
+
+ChatTranscriptPtr ChatTranscriptModel::getTranscript()const
+{
+   return _transcript;
+}
+
+void ChatTranscriptModel::appendEntries( const std::vector<ChatTranscript::Entry>& entries )
+{
+   if( !_transcript || entries.empty() )
+      return;
+   int first = _transcript->size();
+   beginInsertRows( QModelIndex(), first, first + int(entries.size()) - 1 );
+      _transcript->append( entries );
+   endInsertRows();
+}
+
+const ChatTranscript::Entry& ChatTranscriptModel::entry( int row )const
+{
+   // lines are append only, a cached row never changes
+   if( row != _cached_row )
+   {
+      _cached_entry = _transcript->entry( row );
+      _cached_row   = row;
+   }
+   return _cached_entry;
+}
+
+int ChatTranscriptModel::rowCount( const QModelIndex& parent )const
+{
+   if( parent.isValid() || !_transcript )
+      return 0;
+   return _transcript->size();
+}
+
+QVariant ChatTranscriptModel::data( const QModelIndex& index, int role )const
+{
+   if( !index.isValid() || !_transcript ) return QVariant();
+
+   switch( role )
+   {
+      case Qt::DisplayRole:
+      {
+         const auto& line = entry( index.row() );
+         return line.time.toString("hh:mm ap") + " " + line.from + ": " + line.msg;
+      }
+      case Qt::ToolTipRole:
+         return entry( index.row() ).msg;
+      case Qt::ForegroundRole:
+         return entry( index.row() ).from_me ? QColor( "grey" ) : QColor( "black" );
+   }
+   return QVariant();
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <QAbstractListModel>
+#include <QDateTime>
+#include <QFile>
+#include <QString>
+
+#include <fc/crypto/sha512.hpp>
+
+#include <memory>
+#include <vector>
+
+/**
+ *  Append-only, memory mapped chat history for a single contact.
+ *
+ *  Only the offset of each line is held in memory, the text itself stays in
+ *  the mapped file and is decrypted and decoded on demand, so the cost of a
+ *  transcript is 8 bytes per line no matter how long the conversation gets.
+ *
+ *  Each line is encrypted on its own with the key passed to setStorageKey(),
+ *  which is derived from the profile's keychain; without it no transcript
+ *  can be opened.
+ */
+class ChatTranscript
+{
+  public:
+     struct Entry
+     {
+        Entry():from_me(false){}
+        Entry( const QString& from, const QString& msg, const QDateTime& time, bool from_me )
+        :from(from),msg(msg),time(time),from_me(from_me){}
+
+        QString   from;
+        QString   msg;
+        QDateTime time;
+        bool      from_me;
+     };
+
+     ChatTranscript();
+     ~ChatTranscript();
+
+     /** directory that holds one transcript file per contact, created on demand */
+     static void    setStorageDirectory( const QString& dir );
+     static QString storageDirectory();
+     /** key every transcript is encrypted with, set once the profile is unlocked */
+     static void    setStorageKey( const fc::sha512& key );
+
+     /**
+      *  Opens (or creates) the transcript for the contact with the given Keyhotee ID,
+      *  returning the already open instance if someone else holds it.
+      */
+     static std::shared_ptr<ChatTranscript> openForContact( const std::string& dac_id );
+
+     bool open( const QString& file_path );
+     void close();
+     bool isOpen()const;
+
+     int   size()const;
+     Entry entry( int line )const;
+
+     void  append( const Entry& new_entry );
+     void  append( const std::vector<Entry>& new_entries );
+
+  private:
+     void  appendRecord( QByteArray& buffer, const Entry& new_entry );
+     bool  ensureMapped( quint64 end_offset )const;
+
+     mutable QFile         _file;
+     mutable uchar*        _map;
+     mutable qint64        _mapped_size;
+     qint64                _file_size;
+     std::vector<quint64>  _offsets;
+};
+
+typedef std::shared_ptr<ChatTranscript> ChatTranscriptPtr;
+
+/**
+ *  Exposes a ChatTranscript to a QListView.  Combined with uniform item sizes
+ *  the view only lays out and decodes the lines that are actually visible.
+ */
+class ChatTranscriptModel : public QAbstractListModel
+{
+  Q_OBJECT
+  public:
+     ChatTranscriptModel( QObject* parent = nullptr );
+     ~ChatTranscriptModel();
+
+     void              setTranscript( const ChatTranscriptPtr& transcript );
+     ChatTranscriptPtr getTranscript()const;
+
+     void appendEntries( const std::vector<ChatTranscript::Entry>& entries );
+
+     virtual int      rowCount( const QModelIndex& parent = QModelIndex() )const;
+     virtual QVariant data( const QModelIndex& index, int role = Qt::DisplayRole )const;
+
+  private:
+     /** the decoded line, painting a row asks for several roles of it in a row */
+     const ChatTranscript::Entry& entry( int row )const;
+
+     ChatTranscriptPtr             _transcript;
+     mutable int                   _cached_row;
+     mutable ChatTranscript::Entry _cached_entry;
+};
@@ -2,6 +2,7 @@
 #include <QDateTime>
 #include <QString>
 #include <QIcon>
+#include <QImage>
 #include <fc/crypto/elliptic.hpp>
 
 #include <bts/addressbook/contact.hpp>
@@ -15,6 +16,8 @@ class Contact : public bts::addressbook::wallet_contact
    public:
       Contact(){}
       Contact( const bts::addressbook::wallet_contact& );
+      /** uses an icon already decoded from icon_png (ie: on a loader thread) */
+      Contact( const bts::addressbook::wallet_contact&, const QImage& decoded_icon );
 
       QString        getLabel()const;
       const QIcon&   getIcon()const;
@@ -2,13 +2,19 @@
 #include "ui_ContactView.h"
 #include "AddressBookModel.hpp"
 
+#include <AsyncLog.hpp>
+#include <EventJournal.hpp>
+#include <FcEventLoopBridge.hpp>
 #include <KeyhoteeMainWindow.hpp>
+#include <NameRegistryCache.hpp>
+#include <Trace.hpp>
 #include <bts/application.hpp>
 
 #include <fc/thread/thread.hpp>
 #include <fc/log/logger.hpp>
 
 #include <QWebFrame>
+#include <QScrollBar>
 
 bool ContactView::eventFilter(QObject* object, QEvent* event)
 {
@@ -46,7 +52,9 @@ void ContactView::sendChatMessage()
         if( idents.size() )
         {
            fc::ecc::private_key my_priv_key = profile->get_keychain().get_identity_key( idents[0].dac_id );
+           KH_TRACE_SCOPE( "send_text_message" );
            app->send_text_message( text_msg, _current_contact.public_key, my_priv_key );
+           EventJournal::instance().recordChatSent( _current_contact.dac_id_string, text_msg.msg );
            appendChatMessage( "me", msg );
         }
 
@@ -55,28 +63,36 @@ void ContactView::sendChatMessage()
 }
 void ContactView::appendChatMessage( const QString& from, const QString& msg, const QDateTime& date_time )
 { //DLNFIX2 improve formatting later
-    wlog( "append... ${msg}", ("msg",msg.toStdString() ) );
-    QString formatted_msg = date_time.toString("hh:mm ap") + " "+ from + ": " + msg;
-    #if 1
-    QColor color;
-    if (from == "me")
-      color = "grey";
-    else
-      color = "black";
-    ui->chat_conversation->setTextColor(color);
-    ui->chat_conversation->append(formatted_msg);
-    #else //this doesn't start new paragraphs, probably not worth spending
-    //time on as we'll like junk in favor of somethng else later
-    QTextCursor text_cursor = ui->chat_conversation->textCursor();
-    QString colorName = (from == "me") ? "grey" : "black";
-    formatted_msg = QString("<font color=\"%1\">%2</font>").arg(colorName).arg(formatted_msg);
-    ui->chat_conversation->insertHtml(formatted_msg);
-    cursor.movePosition(QTextCursor::NextBlock);
-    ui->chat_conversation->setTextCursor(text_cursor);
-    #endif
+    // never the text itself, the log file isn't encrypted like the transcript
+    KH_DLOG( "append... ${n} chars", ("n",msg.size()) );
+    std::vector<ChatTranscript::Entry> entries;
+    entries.push_back( ChatTranscript::Entry( from, msg, date_time, from == "me" ) );
+    appendChatMessages( entries );
+}
+
+void ContactView::appendChatMessages( const std::vector<ChatTranscript::Entry>& entries )
+{
+    auto scroll_bar = ui->chat_conversation->verticalScrollBar();
+    bool at_bottom = scroll_bar->value() == scroll_bar->maximum();
+
+    // one row insertion, and therefore one layout pass, for the whole burst
+    _chat_model->appendEntries( entries );
+
+    if( at_bottom )
+      ui->chat_conversation->scrollToBottom();
 }
 
 
+QString ContactView::chatDraft()const
+{
+    return ui->chat_input->toPlainText();
+}
+
+void ContactView::setChatDraft( const QString& draft )
+{
+    ui->chat_input->setPlainText(draft);
+}
+
 ContactView::ContactView( QWidget* parent )
 : QWidget(parent),
   ui( new Ui::ContactView() )
@@ -84,7 +100,16 @@ ContactView::ContactView( QWidget* parent )
    _address_book = nullptr;
    _complete = false;
    ui->setupUi(this);
-   //ui->chat_conversation->setHtml( "<html><head></head><body>Hello World<br/></body></html>" );
+
+   // history can be arbitrarily long, only lay out the visible lines
+   _chat_model = new ChatTranscriptModel(this);
+   ui->chat_conversation->setModel( _chat_model );
+   ui->chat_conversation->setUniformItemSizes(true);
+   ui->chat_conversation->setWordWrap(false);
+   ui->chat_conversation->setTextElideMode( Qt::ElideRight );
+   ui->chat_conversation->setSelectionMode( QAbstractItemView::ContiguousSelection );
+   ui->chat_conversation->setEditTriggers( QAbstractItemView::NoEditTriggers );
+   ui->chat_conversation->setVerticalScrollMode( QAbstractItemView::ScrollPerPixel );
    connect( ui->save_button, &QPushButton::clicked, this, &ContactView::onSave );
    connect( ui->cancel_button, &QPushButton::clicked, this, &ContactView::onCancel );
    connect( ui->edit_button, &QPushButton::clicked, this, &ContactView::onEdit );
@@ -187,6 +212,11 @@ ContactView::~ContactView()
 void ContactView::setContact( const Contact& current_contact,
                               ContactDisplay contact_display )
 { try {
+    if( _current_contact.dac_id_string != current_contact.dac_id_string || !_chat_model->getTranscript() )
+    {
+        _chat_model->setTranscript( ChatTranscript::openForContact( current_contact.dac_id_string ) );
+        ui->chat_conversation->scrollToBottom();
+    }
     _current_contact = current_contact;
     bool has_null_public_key = _current_contact.public_key == fc::ecc::public_key_data();
     if ( has_null_public_key )
@@ -292,7 +322,7 @@ void ContactView::keyhoteeIdChanged( const QString& id )
       _complete = false;
       _last_validate = fc::time_point::now();
       ui->id_status->setText( tr( "Looking up id..." ) );
-      fc::async( [=](){ 
+      FcEventLoopBridge::async( [=](){ 
           fc::usleep( fc::microseconds(500*1000) );
           if( fc::time_point::now() > (_last_validate + fc::microseconds(500*1000)) )
           {
@@ -314,7 +344,7 @@ void ContactView::lookupId()
             _complete = false;
             return;
        }
-       _current_record = bts::application::instance()->lookup_name( current_id );
+       _current_record = NameRegistryCache::instance().lookupName( current_id );
        if( _current_record )
        {
             ui->id_status->setText( tr( "Valid ID" ) );
@@ -2,6 +2,7 @@
 #include <QWidget>
 #include <memory>
 #include "Contact.hpp"
+#include "ChatTranscript.hpp"
 #include <fc/time.hpp>
 #include <bts/application.hpp>
 
@@ -40,6 +41,10 @@ class ContactView : public QWidget
      bool isChatSelected();
      void sendChatMessage();
      void appendChatMessage( const QString& from, const QString& msg, const QDateTime& date_time = QDateTime::currentDateTime() );
+     void appendChatMessages( const std::vector<ChatTranscript::Entry>& entries );
+
+     QString chatDraft()const;
+     void    setChatDraft( const QString& draft );
 
   protected:
       bool eventFilter(QObject *obj, QEvent *event);
@@ -50,5 +55,6 @@ class ContactView : public QWidget
      Contact                                   _current_contact;
      fc::optional<bts::bitname::name_record>   _current_record;
      AddressBookModel*                         _address_book;
+     ChatTranscriptModel*                      _chat_model;
      std::unique_ptr<Ui::ContactView>          ui;
 };
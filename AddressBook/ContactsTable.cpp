@@ -24,6 +24,7 @@ void ContactsTable::setAddressBook( AddressBookModel* addressbook_model )
      _sorted_addressbook_model = new QSortFilterProxyModel( this );
      _sorted_addressbook_model->setSourceModel( _addressbook_model );
      _sorted_addressbook_model->setDynamicSortFilter(true);
+     _sorted_addressbook_model->setSortRole( AddressBookModel::SortRole );
      ui->contact_table->setModel( _sorted_addressbook_model );
   }
   ui->contact_table->setShowGrid(false);
@@ -0,0 +1,144 @@
+#include "ReputationFetcher.hpp"
+#include <FcEventLoopBridge.hpp>
+#include <MetricsRegistry.hpp>
+#include <NameRegistryCache.hpp>
+
+#include <fc/thread/thread.hpp>
+#include <fc/log/logger.hpp>
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace
+{
+   const size_t MaxConcurrentLookups = 64;
+   const fc::microseconds FoundRecordLifetime   = fc::seconds(10*60);
+   const fc::microseconds MissingRecordLifetime = fc::seconds(2*60);
+}
+
+struct ReputationFetcher::State
+{
+   State( BatchReadyCallback on_batch_ready )
+   :on_batch_ready(on_batch_ready),flush_scheduled(false),alive(true){}
+
+   BatchReadyCallback                           on_batch_ready;
+   std::unordered_map<std::string,Reputation>   cache;
+   std::vector<std::string>                     pending;
+   std::unordered_set<std::string>              queued;
+   bool                                         flush_scheduled;
+   /// cleared by the fetcher's destructor, the flush task stops at its next check
+   bool                                         alive;
+};
+
+ReputationFetcher::ReputationFetcher( BatchReadyCallback on_batch_ready )
+:_state( std::make_shared<State>( on_batch_ready ) )
+{
+}
+
+ReputationFetcher::~ReputationFetcher()
+{
+   _state->alive = false;
+   _state->on_batch_ready = BatchReadyCallback();
+   _state->pending.clear();
+}
+
+const ReputationFetcher::Reputation* ReputationFetcher::get( const std::string& dac_id )
+{
+   if( dac_id.empty() )
+      return nullptr;
+
+   static Metric& hits   = MetricsRegistry::instance().counter( "reputation_cache.hits" );
+   static Metric& misses = MetricsRegistry::instance().counter( "reputation_cache.misses" );
+
+   auto itr = _state->cache.find( dac_id );
+   if( itr != _state->cache.end() && itr->second.expires > fc::time_point::now() )
+   {
+      hits.add();
+      return &itr->second;
+   }
+   misses.add();
+
+   if( _state->queued.insert( dac_id ).second )
+   {
+      _state->pending.push_back( dac_id );
+      if( !_state->flush_scheduled )
+      {
+         _state->flush_scheduled = true;
+         auto state = _state;
+         FcEventLoopBridge::async( [state](){ flush( state ); } );
+      }
+   }
+   // keep showing the stale value until the refresh lands
+   return itr != _state->cache.end() ? &itr->second : nullptr;
+}
+
+const ReputationFetcher::Reputation* ReputationFetcher::peek( const std::string& dac_id )const
+{
+   auto itr = _state->cache.find( dac_id );
+   return itr != _state->cache.end() ? &itr->second : nullptr;
+}
+
+void ReputationFetcher::invalidate( const std::string& dac_id )
+{
+   _state->cache.erase( dac_id );
+}
+
+void ReputationFetcher::flush( const std::shared_ptr<State>& state )
+{
+   while( state->alive && state->pending.size() )
+   {
+      size_t batch_size = std::min( state->pending.size(), MaxConcurrentLookups );
+      std::vector<std::string> batch( state->pending.begin(), state->pending.begin() + batch_size );
+      state->pending.erase( state->pending.begin(), state->pending.begin() + batch_size );
+
+      // start every lookup of the group before waiting on any of them
+      std::vector< fc::future< fc::optional<bts::bitname::name_record> > > lookups;
+      lookups.reserve( batch.size() );
+      for( auto itr = batch.begin(); itr != batch.end(); ++itr )
+      {
+         std::string dac_id = *itr;
+         lookups.push_back( FcEventLoopBridge::async( [=](){ return NameRegistryCache::instance().lookupName( dac_id ); } ) );
+      }
+
+      for( size_t i = 0; i < batch.size(); ++i )
+      {
+         // the cache can change while waiting, only take the entry once the result is in
+         fc::optional<bts::bitname::name_record> record;
+         bool failed = false;
+         try {
+            record = lookups[i].wait();
+         }
+         catch ( const fc::exception& e )
+         {
+            wlog( "reputation lookup for ${id} failed: ${e}", ("id",batch[i])("e",e.to_string()) );
+            failed = true;
+         }
+         auto now = fc::time_point::now();
+         Reputation& reputation = state->cache[batch[i]];
+         if( failed )
+         {
+            reputation.expires = now + MissingRecordLifetime;
+         }
+         else if( record )
+         {
+            reputation.found   = true;
+            reputation.age     = record->age;
+            reputation.repute  = record->repute;
+            reputation.expires = now + FoundRecordLifetime;
+         }
+         else
+         {
+            reputation.found   = false;
+            reputation.age     = 0;
+            reputation.repute  = 0;
+            reputation.expires = now + MissingRecordLifetime;
+         }
+         state->queued.erase( batch[i] );
+      }
+
+      if( state->alive )
+         state->on_batch_ready( batch );
+   }
+   state->flush_scheduled = false;
+}
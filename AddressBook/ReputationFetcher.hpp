@@ -0,0 +1,54 @@
+#pragma once
+#include <fc/time.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ *  Caches the age and reputation of Keyhotee IDs for the contacts table.
+ *
+ *  Misses are queued rather than looked up immediately.  bts has no batch
+ *  query, so on the next pass of the fc loop the queued ids are looked up
+ *  concurrently, at most MaxConcurrentLookups at a time, and the owner is
+ *  notified once per group rather than once per id.
+ */
+class ReputationFetcher
+{
+  public:
+     struct Reputation
+     {
+        Reputation():found(false),age(0),repute(0){}
+
+        bool           found;
+        uint32_t       age;
+        uint32_t       repute;
+        fc::time_point expires;
+     };
+
+     typedef std::function<void( const std::vector<std::string>& updated_ids )> BatchReadyCallback;
+
+     ReputationFetcher( BatchReadyCallback on_batch_ready );
+     /** lookups still in flight finish on their own, the callback is no longer called */
+     ~ReputationFetcher();
+
+     /**
+      *  @return the cached reputation for dac_id or nullptr if it is unknown or
+      *          expired, in which case a fetch is queued for the next batch.
+      */
+     const Reputation* get( const std::string& dac_id );
+
+     /** the cached reputation, stale or not, without queuing a fetch (ie: for sorting) */
+     const Reputation* peek( const std::string& dac_id )const;
+
+     void invalidate( const std::string& dac_id );
+
+  private:
+     struct State;
+
+     static void flush( const std::shared_ptr<State>& state );
+
+     /// shared with the flush task so it can outlive the fetcher
+     std::shared_ptr<State> _state;
+};
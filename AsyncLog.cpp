@@ -0,0 +1,268 @@
+#include "AsyncLog.hpp"
+#include "MetricsRegistry.hpp"
+
+#include <fc/log/appender.hpp>
+#include <fc/log/logger_config.hpp>
+#include <fc/string.hpp>
+#include <fc/variant.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+   const int  WriterIdleMs = 20;
+   /// the log file is rotated once it reaches this size, keeping MaxLogFiles of them
+   const long MaxLogSize   = 1024*1024;
+   const int  MaxLogFiles  = 3;
+
+   /**
+    *  Bounded queue of log messages, many threads push and the writer pops.
+    *  Each slot carries a sequence number telling whose turn it is, a push
+    *  claims a slot with one compare-exchange and never waits for the writer.
+    */
+   class MessageRing
+   {
+     public:
+        MessageRing( size_t capacity )
+        :_enqueue_pos(0),
+         _dequeue_pos(0)
+        {
+           size_t size = 2;
+           while( size < capacity )
+              size <<= 1;
+           _mask = size - 1;
+           _slots.reset( new Slot[size] );
+           for( size_t i = 0; i < size; ++i )
+              _slots[i].sequence.store( i, std::memory_order_relaxed );
+        }
+
+        /** false when the ring is full */
+        bool push( const fc::log_message& message )
+        {
+           size_t pos = _enqueue_pos.load( std::memory_order_relaxed );
+           Slot*  slot = nullptr;
+           for( ;; )
+           {
+              slot = &_slots[pos & _mask];
+              intptr_t turn = intptr_t( slot->sequence.load( std::memory_order_acquire ) ) - intptr_t( pos );
+              if( turn == 0 )
+              {
+                 if( _enqueue_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) )
+                    break;
+              }
+              else if( turn < 0 )
+                 return false;
+              else
+                 pos = _enqueue_pos.load( std::memory_order_relaxed );
+           }
+           slot->message.reset( new fc::log_message( message ) );
+           slot->sequence.store( pos + 1, std::memory_order_release );
+           return true;
+        }
+
+        /** only called by the writer */
+        std::unique_ptr<fc::log_message> pop()
+        {
+           Slot& slot = _slots[_dequeue_pos & _mask];
+           if( slot.sequence.load( std::memory_order_acquire ) != _dequeue_pos + 1 )
+              return std::unique_ptr<fc::log_message>();
+           std::unique_ptr<fc::log_message> message( std::move( slot.message ) );
+           slot.sequence.store( _dequeue_pos + _mask + 1, std::memory_order_release );
+           ++_dequeue_pos;
+           return message;
+        }
+
+     private:
+        struct Slot
+        {
+           std::atomic<size_t>               sequence;
+           std::unique_ptr<fc::log_message>  message;
+        };
+
+        std::unique_ptr<Slot[]>  _slots;
+        size_t                   _mask;
+        std::atomic<size_t>      _enqueue_pos;
+        size_t                   _dequeue_pos;
+   };
+
+   std::unique_ptr<MessageRing>  gRing;
+   std::unique_ptr<std::thread>  gWriter;
+   std::atomic<bool>             gRunning( false );
+   /// appender calls between reading gRunning and finishing their push
+   std::atomic<int>              gPushesInFlight( 0 );
+   std::atomic<uint64_t>         gDropped( 0 );
+   FILE*                         gLogFile = nullptr;
+   std::string                   gLogPath;
+   /// serializes writes made by callers once the writer is stopped
+   std::mutex                    gDirectWriteMutex;
+   std::mutex                    gWakeupMutex;
+   std::condition_variable       gWakeup;
+
+   void writeLine( const std::string& line )
+   {
+      fwrite( line.data(), 1, line.size(), stderr );
+      if( gLogFile )
+         fwrite( line.data(), 1, line.size(), gLogFile );
+   }
+
+   /** same layout as fc's console appender */
+   void writeMessage( const fc::log_message& message )
+   {
+      const fc::log_context& context = message.get_context();
+      std::string line = fc::string( context.get_timestamp() ) + " " + context.get_thread_name() + " "
+                       + context.get_file() + ":" + fc::to_string( context.get_line_number() ) + " "
+                       + context.get_method() + " " + context.get_log_level().to_string() + "]  "
+                       + fc::format_string( message.get_format(), message.get_data() ) + "\n";
+      writeLine( line );
+   }
+
+   /** log, log.1, ... log.N-1 like StallWatchdog's, the caller holds gDirectWriteMutex */
+   void rotateLog()
+   {
+      if( !gLogFile || ftell( gLogFile ) < MaxLogSize )
+         return;
+      fclose( gLogFile );
+      remove( (gLogPath + "." + fc::to_string( int64_t(MaxLogFiles - 1) )).c_str() );
+      for( int i = MaxLogFiles - 2; i >= 1; --i )
+      {
+         rename( (gLogPath + "." + fc::to_string( int64_t(i) )).c_str(),
+                 (gLogPath + "." + fc::to_string( int64_t(i + 1) )).c_str() );
+      }
+      rename( gLogPath.c_str(), (gLogPath + ".1").c_str() );
+      gLogFile = fopen( gLogPath.c_str(), "a" );
+   }
+
+   void drain( uint64_t& reported_drops )
+   {
+      while( auto message = gRing->pop() )
+         writeMessage( *message );
+
+      uint64_t drops = gDropped.load( std::memory_order_relaxed );
+      if( drops != reported_drops )
+      {
+         writeLine( "log ring full, dropped " + fc::to_string( drops - reported_drops ) + " messages\n" );
+         reported_drops = drops;
+      }
+      fflush( stderr );
+      if( gLogFile )
+         fflush( gLogFile );
+   }
+
+   void runWriter()
+   {
+      uint64_t reported_drops = 0;
+      while( gRunning )
+      {
+         drain( reported_drops );
+         {
+            // direct writes only happen while stopping, but they use gLogFile too
+            std::lock_guard<std::mutex> lock( gDirectWriteMutex );
+            rotateLog();
+         }
+         std::unique_lock<std::mutex> lock( gWakeupMutex );
+         gWakeup.wait_for( lock, std::chrono::milliseconds( WriterIdleMs ) );
+      }
+      drain( reported_drops );
+   }
+
+   class AsyncLogAppender : public fc::appender
+   {
+     public:
+        AsyncLogAppender( const fc::variant& /*args*/ ){}
+
+        virtual void log( const fc::log_message& message )
+        {
+           // stop() waits for this count to reach zero before its final drain
+           gPushesInFlight.fetch_add( 1 );
+           if( gRunning )
+           {
+              bool pushed = gRing->push( message );
+              gPushesInFlight.fetch_sub( 1 );
+              if( pushed )
+                 return;
+              static Metric& dropped = MetricsRegistry::instance().counter( "log.dropped" );
+              dropped.add();
+              gDropped.fetch_add( 1, std::memory_order_relaxed );
+              return;
+           }
+           gPushesInFlight.fetch_sub( 1 );
+           std::lock_guard<std::mutex> lock( gDirectWriteMutex );
+           writeMessage( message );
+        }
+   };
+}
+
+namespace AsyncLog
+{
+   void start( const std::string& log_file, size_t capacity )
+   {
+      if( gRunning )
+         return;
+      if( !gRing )
+         gRing.reset( new MessageRing( capacity ) );
+      if( !gLogFile && !log_file.empty() )
+      {
+         gLogPath = log_file;
+         gLogFile = fopen( log_file.c_str(), "a" );
+         if( gLogFile )
+         {
+            // "a" leaves the position at 0 until the first write, rotateLog() needs the size
+            fseek( gLogFile, 0, SEEK_END );
+            rotateLog();
+         }
+      }
+
+      gRunning = true;
+      gWriter.reset( new std::thread( runWriter ) );
+
+      static bool registered = fc::appender::register_appender<AsyncLogAppender>( "keyhotee_async" );
+      (void)registered;
+      fc::logging_config config;
+      config.appenders.push_back( fc::appender_config( "async", "keyhotee_async" ) );
+      fc::logger_config default_logger( "default" );
+#ifdef NDEBUG
+      default_logger.level = fc::log_level::info;
+#else
+      default_logger.level = fc::log_level::debug;
+#endif
+      default_logger.appenders.push_back( "async" );
+      config.loggers.push_back( default_logger );
+      fc::configure_logging( config );
+
+      if( !gLogFile && !log_file.empty() )
+         wlog( "unable to open log file ${f}, logging to stderr only", ("f",log_file) );
+   }
+
+   void stop()
+   {
+      if( !gRunning.exchange( false ) )
+         return;
+      gWakeup.notify_one();
+      gWriter->join();
+      gWriter.reset();
+
+      // a push that saw gRunning just before it went false may land after the writer's last drain,
+      // later ones see it false and write directly
+      while( gPushesInFlight.load() != 0 )
+         std::this_thread::yield();
+      std::lock_guard<std::mutex> lock( gDirectWriteMutex );
+      uint64_t reported_drops = gDropped;
+      drain( reported_drops );
+      if( gLogFile )
+      {
+         fclose( gLogFile );
+         gLogFile = nullptr;
+      }
+   }
+
+   uint64_t dropped()
+   {
+      return gDropped;
+   }
+}
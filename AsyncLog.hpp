@@ -0,0 +1,38 @@
+#pragma once
+#include <fc/log/logger.hpp>
+
+#include <string>
+
+#include <stdint.h>
+
+/**
+ *  dlog that only exists in debug builds; release builds drop the call and
+ *  never evaluate its arguments.  Use it for anything logged per contact,
+ *  per message or per keystroke.
+ */
+#ifdef NDEBUG
+#define KH_DLOG( ... ) do {} while( 0 )
+#else
+#define KH_DLOG( ... ) dlog( __VA_ARGS__ )
+#endif
+
+/**
+ *  Moves fc log output off the threads that log.
+ *
+ *  Once started the default fc logger hands each message, still unformatted,
+ *  to a lock-free ring; a writer thread formats it and writes it to stderr and
+ *  the log file.  When the ring is full the message is dropped and counted,
+ *  the writer reports how many were lost.  The log file is rotated at 1 MB,
+ *  keeping the last three.  Debug messages are only enabled in debug builds.
+ */
+namespace AsyncLog
+{
+   enum { DefaultCapacity = 4096 };
+
+   /** routes the default logger through the ring, capacity is rounded up to a power of two */
+   void start( const std::string& log_file, size_t capacity = DefaultCapacity );
+   /** writes out what is queued and stops the writer, later messages are written by the caller */
+   void stop();
+   /** messages dropped because the ring was full */
+   uint64_t dropped();
+}
@@ -0,0 +1,269 @@
+/**
+ *  model_bench [--contacts N] [--messages M] [--output results.json]
+ *
+ *  Times AddressBookModel, InboxModel and ContactListEdit against a synthetic
+ *  profile, no bts profile or network involved, and writes the results as JSON
+ *  (stdout when no --output is given).  Runs on the offscreen Qt platform unless
+ *  QT_QPA_PLATFORM says otherwise.
+ *
+ *  Every measurement is reported in milliseconds along with the number of
+ *  operations it covers, compare runs of the same N / M between releases.
+ */
+#include "AddressBook/AddressBookModel.hpp"
+#include "Mail/InboxModel.hpp"
+#include "ContactListEdit.hpp"
+
+#include <QApplication>
+#include <QBuffer>
+#include <QCompleter>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QScrollBar>
+#include <QSortFilterProxyModel>
+#include <QTableView>
+
+#include <cstdio>
+
+namespace
+{
+   const char* const FirstNames[] = { "Alice", "Bob", "Carol", "Dave", "Erin", "Frank", "Grace", "Heidi",
+                                      "Ivan", "Judy", "Mallory", "Niaj", "Olivia", "Peggy", "Rupert", "Sybil" };
+   const char* const LastNames[]  = { "Smith", "Jones", "Brown", "Taylor", "Wilson", "Davies", "Evans", "Thomas",
+                                      "Johnson", "Roberts", "Walker", "Wright", "Robinson", "Thompson", "White", "Hughes" };
+
+   class Bench
+   {
+      public:
+         void record( const QString& name, qint64 nsecs, int operations )
+         {
+            QJsonObject result;
+            result["name"]       = name;
+            result["ms"]         = nsecs / 1e6;
+            result["operations"] = operations;
+            result["ns_per_op"]  = operations ? double( nsecs ) / operations : 0.0;
+            _results.append( result );
+            fprintf( stderr, "%-40s %10.3f ms %10d ops\n", qPrintable( name ), nsecs / 1e6, operations );
+         }
+
+         QJsonArray results()const { return _results; }
+
+      private:
+         QJsonArray _results;
+   };
+
+   /** every 4th contact gets an icon so decoding shows up in the load numbers */
+   std::vector<bts::addressbook::wallet_contact> makeContacts( int count )
+   {
+      QImage icon( 48, 48, QImage::Format_ARGB32 );
+      icon.fill( Qt::darkCyan );
+      QByteArray png;
+      QBuffer buffer( &png );
+      buffer.open( QIODevice::WriteOnly );
+      icon.save( &buffer, "PNG" );
+
+      std::vector<bts::addressbook::wallet_contact> contacts( count );
+      for( int i = 0; i < count; ++i )
+      {
+         auto& contact = contacts[i];
+         contact.wallet_index  = i;
+         contact.first_name    = FirstNames[i % 16];
+         contact.last_name     = std::string( LastNames[(i / 16) % 16] ) + std::to_string( i );
+         contact.dac_id_string = "id" + std::to_string( i * 7919 % 1000003 );
+         if( i % 4 == 0 )
+            contact.icon_png.assign( png.begin(), png.end() );
+      }
+      return contacts;
+   }
+
+   std::vector<MessageHeader> makeMessages( int count, int contact_count )
+   {
+      QDateTime now = QDateTime::currentDateTime();
+      std::vector<MessageHeader> headers( count );
+      for( int i = 0; i < count; ++i )
+      {
+         auto& header = headers[i];
+         header.from          = QString( "id%1" ).arg( (i % std::max( 1, contact_count )) * 7919 % 1000003 );
+         header.to            = "me";
+         header.subject       = QString( "Synthetic message %1 about %2" ).arg( i ).arg( FirstNames[i % 16] );
+         header.date_received = now.addSecs( -60 * i );
+         header.date_sent     = header.date_received.addSecs( -5 );
+         header.read_mark     = i % 3 != 0;
+         header.attachment    = i % 10 == 0;
+      }
+      return headers;
+   }
+
+   /** data() for every cell, once per role */
+   void benchDataRoles( Bench& bench, const QString& model_name, QAbstractItemModel& model )
+   {
+      const int roles[]            = { Qt::DisplayRole, Qt::DecorationRole, Qt::ToolTipRole, Qt::SizeHintRole };
+      const char* const role_names[] = { "display", "decoration", "tooltip", "size_hint" };
+      for( int r = 0; r < 4; ++r )
+      {
+         QElapsedTimer timer;
+         timer.start();
+         int calls = 0;
+         for( int row = 0; row < model.rowCount(); ++row )
+            for( int column = 0; column < model.columnCount(); ++column, ++calls )
+               model.data( model.index( row, column ), roles[r] );
+         bench.record( model_name + ".data." + role_names[r], timer.nsecsElapsed(), calls );
+      }
+   }
+
+   void benchSortAndFilter( Bench& bench, const QString& model_name, QAbstractItemModel& model, int filter_column )
+   {
+      QSortFilterProxyModel proxy;
+      proxy.setSourceModel( &model );
+      proxy.setDynamicSortFilter( true );
+
+      QElapsedTimer timer;
+      timer.start();
+      for( int column = 0; column < model.columnCount(); ++column )
+      {
+         proxy.sort( column, Qt::AscendingOrder );
+         proxy.sort( column, Qt::DescendingOrder );
+      }
+      bench.record( model_name + ".sort.all_columns", timer.nsecsElapsed(), model.columnCount() * 2 );
+
+      const char* const filters[] = { "a", "Ali", "id1", "zzz" };
+      proxy.setFilterKeyColumn( filter_column );
+      proxy.setFilterCaseSensitivity( Qt::CaseInsensitive );
+      timer.restart();
+      for( int f = 0; f < 4; ++f )
+         proxy.setFilterFixedString( filters[f] );
+      proxy.setFilterFixedString( QString() );
+      bench.record( model_name + ".filter", timer.nsecsElapsed(), 5 );
+   }
+
+   /** one synchronous repaint per page, top to bottom */
+   void benchScrolling( Bench& bench, const QString& model_name, QAbstractItemModel& model )
+   {
+      QTableView view;
+      view.resize( 1000, 800 );
+      view.setModel( &model );
+      view.show();
+      qApp->processEvents();
+
+      auto scroll_bar = view.verticalScrollBar();
+      QElapsedTimer timer;
+      timer.start();
+      int frames = 0;
+      for( int value = scroll_bar->minimum(); ; value += scroll_bar->pageStep(), ++frames )
+      {
+         scroll_bar->setValue( value );
+         view.viewport()->repaint();
+         if( value >= scroll_bar->maximum() )
+            break;
+      }
+      bench.record( model_name + ".scroll.pages", timer.nsecsElapsed(), frames + 1 );
+   }
+
+   void benchCompletion( Bench& bench, AddressBookModel& address_book, int contact_count )
+   {
+      QCompleter completer;
+      completer.setModel( address_book.GetContactCompletionModel() );
+      completer.setCaseSensitivity( Qt::CaseInsensitive );
+
+      const char* const prefixes[] = { "A", "Al", "Alice", "B", "id", "id12", "G", "Gr" };
+      QElapsedTimer timer;
+      timer.start();
+      int matches = 0;
+      for( int p = 0; p < 8; ++p )
+      {
+         completer.setCompletionPrefix( prefixes[p] );
+         matches += completer.completionCount();
+      }
+      bench.record( "ContactListEdit.completion.prefixes", timer.nsecsElapsed(), 8 );
+      if( matches == 0 )
+         fprintf( stderr, "warning: no completions matched\n" );
+
+      ContactListEdit edit;
+      edit.setCompleter( &completer );
+      edit.setAddressBook( &address_book );
+      edit.resize( 600, 40 );
+      edit.show();
+      qApp->processEvents();
+
+      int recipients = std::min( contact_count, 50 );
+      timer.restart();
+      for( int i = 0; i < recipients; ++i )
+      {
+         edit.insertCompletion( QString( "%1 %2" ).arg( FirstNames[i % 16] ).arg( i ) );
+      }
+      qApp->processEvents();
+      bench.record( "ContactListEdit.insertCompletion", timer.nsecsElapsed(), recipients );
+   }
+}
+
+int main( int argc, char** argv )
+{
+   if( qgetenv( "QT_QPA_PLATFORM" ).isEmpty() )
+      qputenv( "QT_QPA_PLATFORM", "offscreen" );
+   QApplication app( argc, argv );
+
+   int     contact_count = 1000;
+   int     message_count = 10000;
+   QString output_file;
+   QStringList args = app.arguments();
+   for( int i = 1; i + 1 < args.size(); i += 2 )
+   {
+      if( args[i] == "--contacts" )
+         contact_count = args[i + 1].toInt();
+      else if( args[i] == "--messages" )
+         message_count = args[i + 1].toInt();
+      else if( args[i] == "--output" )
+         output_file = args[i + 1];
+   }
+
+   Bench bench;
+   QElapsedTimer timer;
+
+   auto contacts = makeContacts( contact_count );
+   timer.start();
+   AddressBookModel address_book( nullptr, bts::addressbook::addressbook_ptr(), false );
+   auto snapshot = AddressBookModel::loadContacts( contacts );
+   bench.record( "AddressBookModel.loadContacts", timer.nsecsElapsed(), contact_count );
+   timer.restart();
+   address_book.setContacts( snapshot );
+   bench.record( "AddressBookModel.setContacts", timer.nsecsElapsed(), contact_count );
+
+   benchDataRoles( bench, "AddressBookModel", address_book );
+   benchSortAndFilter( bench, "AddressBookModel", address_book, AddressBookModel::LastName );
+   benchScrolling( bench, "AddressBookModel", address_book );
+
+   auto messages = makeMessages( message_count, contact_count );
+   timer.restart();
+   InboxModel inbox( nullptr, bts::profile_ptr(), false );
+   inbox.setMessageHeaders( messages );
+   bench.record( "InboxModel.setMessageHeaders", timer.nsecsElapsed(), message_count );
+
+   benchDataRoles( bench, "InboxModel", inbox );
+   benchSortAndFilter( bench, "InboxModel", inbox, InboxModel::Subject );
+   benchScrolling( bench, "InboxModel", inbox );
+
+   benchCompletion( bench, address_book, contact_count );
+
+   QJsonObject report;
+   report["contacts"] = contact_count;
+   report["messages"] = message_count;
+   report["qt_version"] = QString( qVersion() );
+   report["platform"] = QGuiApplication::platformName();
+   report["results"]  = bench.results();
+   QByteArray json = QJsonDocument( report ).toJson();
+
+   if( output_file.isEmpty() )
+   {
+      fwrite( json.constData(), 1, json.size(), stdout );
+      return 0;
+   }
+   QFile file( output_file );
+   if( !file.open( QIODevice::WriteOnly ) || file.write( json ) != json.size() )
+   {
+      fprintf( stderr, "unable to write %s\n", qPrintable( output_file ) );
+      return 1;
+   }
+   return 0;
+}
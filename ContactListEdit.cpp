@@ -1,21 +1,105 @@
 #include "ContactListEdit.hpp"
+#include "AddressBook/AddressBookModel.hpp"
+#include "AsyncLog.hpp"
+#include "MetricsRegistry.hpp"
 #include <QCompleter>
 #include <QAbstractItemView>
+#include <QAbstractTextDocumentLayout>
 #include <QKeyEvent>
-#include <QScrolLBar>
+#include <QMimeData>
+#include <QScrollBar>
+#include <QCache>
 #include <QPainter>
+#include <QtMath>
+#include <QTextDocument>
+#include <QTextImageFormat>
 
 #include <fc/log/logger.hpp>
 
+RecipientDocument::RecipientDocument( QObject* parent )
+:QTextDocument(parent)
+{
+   // undoing a deletion would bring back a chip whose recipient is gone
+   setUndoRedoEnabled(false);
+   connect( this, &QTextDocument::contentsChange, [=]( int position, int chars_removed, int chars_added ){
+            recipientsRemoved( position, chars_removed, chars_added ); } );
+}
+
+void RecipientDocument::clear()
+{
+   _recipients.clear();
+   QTextDocument::clear();
+}
+
+std::vector<RecipientDocument::Recipient> RecipientDocument::recipients()const
+{
+   std::vector<Recipient> result;
+   result.reserve( _recipients.size() );
+   for( auto itr = _recipients.begin(); itr != _recipients.end(); ++itr )
+   {
+      result.push_back( itr->recipient );
+   }
+   return result;
+}
+
+void RecipientDocument::insertRecipient( QTextCursor& cursor, const Recipient& recipient, const QTextImageFormat& chip_format )
+{
+   TrackedRecipient tracked;
+   tracked.chip      = QTextCursor( this );
+   tracked.recipient = recipient;
+   int position = cursor.position();
+   cursor.insertImage( chip_format );
+   tracked.chip.setPosition( position );
+
+   // cursors keep their relative order through any edit, so the vector stays sorted
+   auto itr = _recipients.begin();
+   while( itr != _recipients.end() && itr->chip.position() < position )
+   {
+      ++itr;
+   }
+   _recipients.insert( itr, tracked );
+}
+
+void RecipientDocument::recipientsRemoved( int position, int chars_removed, int chars_added )
+{
+   if( chars_removed == 0 || _recipients.empty() )
+      return;
+
+   // a deleted chip leaves its cursor on whatever follows, possibly another chip
+   int last_position = -1;
+   auto keep = _recipients.begin();
+   for( auto itr = _recipients.begin(); itr != _recipients.end(); ++itr )
+   {
+      int  chip_position = itr->chip.position();
+      bool on_chip       = chip_position != last_position &&
+                           characterAt( chip_position ) == QChar::ObjectReplacementCharacter;
+      if( on_chip )
+      {
+         QTextCursor chip( this );
+         chip.setPosition( chip_position + 1 );
+         on_chip = chip.charFormat().toImageFormat().name() == itr->recipient.label;
+      }
+      if( on_chip )
+      {
+         last_position = chip_position;
+         if( keep != itr )
+            *keep = *itr;
+         ++keep;
+      }
+   }
+   _recipients.erase( keep, _recipients.end() );
+}
+
 ContactListEdit::ContactListEdit( QWidget* parent )
 :QTextEdit(parent)
 {
-   _completer = nullptr;
-
-   connect( this, &QTextEdit::textChanged, this, &ContactListEdit::fitHeightToDocument ); 
+   _completer     = nullptr;
+   _address_book  = nullptr;
+   _recipients    = nullptr;
+   _fitted_height = -1;
+   setDocument( new RecipientDocument(this) );
 
    setSizePolicy( QSizePolicy::MinimumExpanding, QSizePolicy::Preferred );
-   fitHeightToDocument();
 
    setHorizontalScrollBarPolicy( Qt::ScrollBarAlwaysOff );
    setVerticalScrollBarPolicy( Qt::ScrollBarAlwaysOff );
@@ -53,29 +137,125 @@ QCompleter* ContactListEdit::getCompleter()
     return _completer;
 }
 
+void ContactListEdit::setAddressBook( AddressBookModel* address_book )
+{
+    _address_book = address_book;
+}
+
+void ContactListEdit::setDocument( RecipientDocument* document )
+{
+    if( _recipients )
+    {
+        QObject::disconnect( _recipients->documentLayout(), 0, this, 0 );
+    }
+    _recipients = document;
+    QTextEdit::setDocument(document);
+
+    // the layout relays out only the blocks an edit touched and reports when that changes the size
+    connect( document->documentLayout(), &QAbstractTextDocumentLayout::documentSizeChanged,
+             this, &ContactListEdit::fitHeightToDocument );
+    fitHeightToDocument( document->documentLayout()->documentSize() );
+}
+
+std::vector<RecipientDocument::Recipient> ContactListEdit::recipients()const
+{
+    return _recipients->recipients();
+}
+
+void ContactListEdit::addRecipient( const RecipientDocument::Recipient& recipient )
+{
+    QTextCursor text_cursor = textCursor();
+    text_cursor.movePosition( QTextCursor::End );
+    insertRecipient( text_cursor, recipient );
+    setTextCursor(text_cursor);
+}
+
 
 void ContactListEdit::insertCompletion( const QString& completion )
 {
-   ilog( "insertCompletion ${c}", ("c", completion.toStdString() ) );
+   KH_DLOG( "insertCompletion ${c}", ("c", completion.toStdString() ) );
   // remove existing text
   // create image, attach meta data for on-click menus
 
     if (_completer->widget() != this)
         return;
-    QFont        default_font;
+
+    RecipientDocument::Recipient recipient;
+    recipient.label = completion;
+    if( _address_book )
+    {
+        recipient.contact_id = _address_book->findContactIdByCompletion( completion );
+        if( recipient.contact_id != -1 )
+        {
+            const Contact& contact = _address_book->getContactById( recipient.contact_id );
+            recipient.dac_id     = contact.dac_id_string;
+            recipient.public_key = contact.public_key;
+        }
+    }
+
+    QTextCursor text_cursor = textCursor();
+    uint32_t prefix_len =  _completer->completionPrefix().length();
+    for( uint32_t i = 0; i < prefix_len; ++i )
+    {
+        text_cursor.deletePreviousChar();
+    }
+   // int extra = completion.length() -
+   // tc.movePosition(QTextCursor::Left);
+   // tc.movePosition(QTextCursor::EndOfWord);
+   // tc.insertText(completion.right(extra));
+    insertRecipient( text_cursor, recipient );
+    setTextCursor(text_cursor);
+}
+
+void ContactListEdit::insertRecipient( QTextCursor& text_cursor, const RecipientDocument::Recipient& recipient )
+{
+    QFont default_font;
     default_font.setPointSize( default_font.pointSize() - 2 );
-    QFontMetrics font_metrics(default_font);
-    QRect        bounding = font_metrics.boundingRect( completion );
-    int          completion_width = font_metrics.width( completion );
-    int          completion_height = bounding.height();
+    qreal device_pixel_ratio = devicePixelRatio();
+    QImage completion_image = recipientChip( recipient.label, default_font, device_pixel_ratio );
+
+    // the document keeps one resource per label, every chip of that recipient refers to it
+    QUrl resource_name( recipient.label );
+    QVariant resource = document()->resource( QTextDocument::ImageResource, resource_name );
+    if( !resource.isValid() || resource.value<QImage>().cacheKey() != completion_image.cacheKey() )
+    {
+        document()->addResource( QTextDocument::ImageResource, resource_name, completion_image );
+    }
+    QTextImageFormat chip_format;
+    chip_format.setName( recipient.label );
+    chip_format.setWidth( completion_image.width() / device_pixel_ratio );
+    chip_format.setHeight( completion_image.height() / device_pixel_ratio );
+
+    _recipients->insertRecipient( text_cursor, recipient, chip_format );
+    text_cursor.insertText(" ");
+}
+
+QImage ContactListEdit::recipientChip( const QString& label, const QFont& font, qreal device_pixel_ratio )
+{
+    // shared by every ContactListEdit, images are implicitly shared with the documents using them
+    static QCache<QString,QImage> chip_cache( MaxChipCacheBytes );
+    static Metric& hits   = MetricsRegistry::instance().counter( "chip_cache.hits" );
+    static Metric& misses = MetricsRegistry::instance().counter( "chip_cache.misses" );
 
-    completion_width += 20;
+    QString key = QString( "%1\n%2\n%3" ).arg( label, font.key(), QString::number( device_pixel_ratio ) );
+    if( QImage* cached = chip_cache.object( key ) )
+    {
+        hits.add();
+        return *cached;
+    }
+    misses.add();
 
-    QImage completion_image( completion_width, completion_height+4, QImage::Format_ARGB32 );
+    QFontMetrics font_metrics(font);
+    QRect        bounding = font_metrics.boundingRect( label );
+    int          completion_width = font_metrics.width( label ) + 20;
+    int          completion_height = bounding.height();
+
+    QImage completion_image( QSize( completion_width, completion_height+4 ) * device_pixel_ratio, QImage::Format_ARGB32_Premultiplied );
+    completion_image.setDevicePixelRatio( device_pixel_ratio );
     completion_image.fill( QColor( 0,0,0,0 ) );
     QPainter painter;
     painter.begin(&completion_image);
-    painter.setFont(default_font);
+    painter.setFont(font);
     painter.setRenderHint( QPainter::Antialiasing );
 
     QBrush brush(Qt::SolidPattern);
@@ -85,23 +265,13 @@ void ContactListEdit::insertCompletion( const QString& completion )
 
     painter.setBrush( brush );
     painter.setPen(pen);
-    painter.drawRoundedRect( 0, 0, completion_width-1, completion_image.height()-1, 8, 8, Qt::AbsoluteSize );
+    painter.drawRoundedRect( 0, 0, completion_width-1, completion_height+3, 8, 8, Qt::AbsoluteSize );
     painter.setPen(QPen());
-    painter.drawText( QPoint( 10, completion_height - 2 ), completion );
+    painter.drawText( QPoint( 10, completion_height - 2 ), label );
+    painter.end();
 
-    QTextCursor text_cursor = textCursor();
-    uint32_t prefix_len =  _completer->completionPrefix().length();
-    for( uint32_t i = 0; i < prefix_len; ++i )
-    {
-        text_cursor.deletePreviousChar();
-    }
-   // int extra = completion.length() -
-   // tc.movePosition(QTextCursor::Left);
-   // tc.movePosition(QTextCursor::EndOfWord);
-   // tc.insertText(completion.right(extra));
-    text_cursor.insertImage( completion_image, completion );
-    text_cursor.insertText(" ");
-    setTextCursor(text_cursor);
+    chip_cache.insert( key, new QImage( completion_image ), completion_image.byteCount() );
+    return completion_image;
 }
 
 //! [5]
@@ -186,18 +356,22 @@ QSize ContactListEdit::sizeHint() const
      return sizehint;
 }
 
-void ContactListEdit::fitHeightToDocument() 
+void ContactListEdit::fitHeightToDocument( const QSizeF& document_size )
 {
-     document()->setTextWidth(width());
-     QSize document_size(document()->size().toSize());
- //    _fitted_height = document_size.height();
+     // typing within a line leaves the height alone, only a change in line count reaches the form
+     int fitted_height = qCeil( document_size.height() );
+     if( fitted_height == _fitted_height )
+        return;
+     _fitted_height = fitted_height;
 
-     setMaximumHeight(document_size.height());
+     setMaximumHeight(_fitted_height);
      updateGeometry();
 }
 
-void ContactListEdit::resizeEvent( QResizeEvent* resize_event )
+void ContactListEdit::insertFromMimeData( const QMimeData* source )
 {
-    fitHeightToDocument();
-    QTextEdit::resizeEvent(resize_event);
+    // chips only come from completions, a pasted object replacement character would be an orphan
+    QString text = source->text();
+    text.remove( QChar::ObjectReplacementCharacter );
+    insertPlainText( text );
 }
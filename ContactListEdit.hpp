@@ -1,7 +1,57 @@
 #pragma once
+#include <QImage>
 #include <QTextEdit>
+#include <QTextCursor>
+#include <QTextDocument>
+
+#include <fc/crypto/elliptic.hpp>
+
+#include <string>
+#include <vector>
 
 class QCompleter;
+class QTextImageFormat;
+class AddressBookModel;
+
+/**
+ *  Document behind a ContactListEdit.  Besides the chips it holds the
+ *  recipients they stand for, in document order, and drops a recipient as
+ *  soon as its chip is deleted.  MailEditor keeps these across the address
+ *  bar being rebuilt, so the recipients live here rather than in the widget.
+ */
+class RecipientDocument : public QTextDocument
+{
+   public:
+      struct Recipient
+      {
+         Recipient():contact_id(-1){}
+
+         QString              label;
+         /// -1 when the label matched no contact
+         int                  contact_id;
+         std::string          dac_id;
+         fc::ecc::public_key  public_key;
+      };
+
+      RecipientDocument( QObject* parent = nullptr );
+
+      virtual void clear();
+
+      std::vector<Recipient> recipients()const;
+      /** inserts a chip for recipient at cursor and starts tracking it */
+      void insertRecipient( QTextCursor& cursor, const Recipient& recipient, const QTextImageFormat& chip_format );
+
+   private:
+      void recipientsRemoved( int position, int chars_removed, int chars_added );
+
+      struct TrackedRecipient
+      {
+         /// sits on the chip, moves with edits before it
+         QTextCursor chip;
+         Recipient   recipient;
+      };
+      std::vector<TrackedRecipient> _recipients;
+};
 
 /**
  * @brief provides an implementation 'smart addresses' with auto-complete 
@@ -16,6 +66,14 @@ class ContactListEdit : public QTextEdit
 
       void setCompleter( QCompleter* completer );
       QCompleter* getCompleter();
+      /** completions are resolved to contacts through address_book as they are inserted */
+      void setAddressBook( AddressBookModel* address_book );
+      /** hides QTextEdit::setDocument(), recipients can only be kept by a RecipientDocument */
+      void setDocument( RecipientDocument* document );
+
+      std::vector<RecipientDocument::Recipient> recipients()const;
+      /** appends a chip for a recipient resolved by the caller */
+      void addRecipient( const RecipientDocument::Recipient& recipient );
 
       QSize sizeHint() const;
       QSize maximumSizeHint() const { return sizeHint(); }
@@ -23,17 +81,25 @@ class ContactListEdit : public QTextEdit
    protected:
        void keyPressEvent( QKeyEvent* key_event );
        void focusInEvent( QFocusEvent* focus_event );
-       void resizeEvent( QResizeEvent* resize_event );
+       /** pasted chips would have no recipient behind them, paste plain text only */
+       void insertFromMimeData( const QMimeData* source );
    
    public Q_SLOTS:
        void insertCompletion( const QString& completion );
    private Q_SLOTS:
-       void fitHeightToDocument();
+       void fitHeightToDocument( const QSizeF& document_size );
 
    private:
        QString textUnderCursor()const;
+       void    insertRecipient( QTextCursor& text_cursor, const RecipientDocument::Recipient& recipient );
+       /** the rendered chip for a recipient, cached by label, font and device pixel ratio */
+       static QImage recipientChip( const QString& label, const QFont& font, qreal device_pixel_ratio );
+
+       enum { MaxChipCacheBytes = 4 * 1024 * 1024 };
 
    private:
-      int         _fitted_height;
-      QCompleter* _completer;
+      int                _fitted_height;
+      QCompleter*        _completer;
+      AddressBookModel*  _address_book;
+      RecipientDocument* _recipients;
 };
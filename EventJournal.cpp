@@ -0,0 +1,193 @@
+#include "EventJournal.hpp"
+
+#include <fc/io/datastream.hpp>
+#include <fc/io/raw.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/reflect/variant.hpp>
+
+#include <QDataStream>
+
+namespace
+{
+   const char    JournalMagic[3] = { 'K', 'H', 'J' };
+   const quint8  JournalVersion  = 1;
+
+   template<typename T>
+   void appendPacked( std::vector<char>& payload, const T& value )
+   {
+      auto packed = fc::raw::pack( value );
+      payload.insert( payload.end(), packed.begin(), packed.end() );
+   }
+}
+
+EventJournal& EventJournal::instance()
+{
+   static EventJournal journal;
+   return journal;
+}
+
+EventJournal::EventJournal()
+{}
+
+EventJournal::~EventJournal()
+{
+   stopRecording();
+}
+
+bool EventJournal::startRecording( const QString& journal_file )
+{
+   std::unique_ptr<QFile> file( new QFile( journal_file ) );
+   if( !file->open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+   {
+      elog( "unable to record to ${f}", ("f",journal_file.toStdString()) );
+      return false;
+   }
+   // the journal is plaintext, keep it away from other users of the machine
+   file->setPermissions( QFileDevice::ReadOwner | QFileDevice::WriteOwner );
+   file->write( JournalMagic, sizeof(JournalMagic) );
+   file->write( (const char*)&JournalVersion, 1 );
+   _file.swap( file );
+   _clock.start();
+   wlog( "recording delegate events to ${f}, messages and contacts are written unencrypted", ("f",journal_file.toStdString()) );
+   return true;
+}
+
+void EventJournal::stopRecording()
+{
+   if( _file )
+   {
+      _file->flush();
+      _file.reset();
+   }
+}
+
+void EventJournal::write( EventType type, const std::vector<char>& payload )
+{
+   QDataStream out( _file.get() );
+   out.setByteOrder( QDataStream::LittleEndian );
+   out << quint8( type ) << qint64( _clock.nsecsElapsed() / 1000 ) << QByteArray( payload.data(), payload.size() );
+   // a journal is most useful right after a crash, don't leave events in the buffer
+   _file->flush();
+}
+
+void EventJournal::recordReceived( EventType type, const bts::bitchat::decrypted_message& msg )
+{
+   if( !_file )
+      return;
+   std::vector<char> payload;
+   appendPacked( payload, msg );
+   // from_key is recovered from the signature on decrypt, it isn't part of the packed message
+   appendPacked( payload, msg.from_key );
+   write( type, payload );
+}
+
+void EventJournal::recordContactList( const std::vector<bts::addressbook::wallet_contact>& contacts )
+{
+   if( !_file )
+      return;
+   write( ContactList, fc::raw::pack( contacts ) );
+}
+
+void EventJournal::recordContactStored( const bts::addressbook::wallet_contact& contact )
+{
+   if( !_file )
+      return;
+   write( ContactStored, fc::raw::pack( contact ) );
+}
+
+void EventJournal::recordChatSent( const std::string& to_dac_id, const std::string& text )
+{
+   if( !_file )
+      return;
+   std::vector<char> payload;
+   appendPacked( payload, to_dac_id );
+   appendPacked( payload, text );
+   write( ChatSent, payload );
+}
+
+void EventJournal::recordMailSent( const std::vector<std::string>& to_dac_ids, const bts::bitchat::private_email_message& mail )
+{
+   if( !_file )
+      return;
+   std::vector<char> payload;
+   appendPacked( payload, to_dac_ids );
+   appendPacked( payload, mail );
+   write( MailSent, payload );
+}
+
+bool EventJournal::read( const QString& journal_file, std::vector<Event>& events )
+{
+   QFile file( journal_file );
+   if( !file.open( QIODevice::ReadOnly ) )
+      return false;
+
+   char   magic[sizeof(JournalMagic)];
+   quint8 version = 0;
+   if( file.read( magic, sizeof(magic) ) != sizeof(magic) || memcmp( magic, JournalMagic, sizeof(magic) ) != 0 ||
+       file.read( (char*)&version, 1 ) != 1 || version != JournalVersion )
+   {
+      return false;
+   }
+
+   QDataStream in( &file );
+   in.setByteOrder( QDataStream::LittleEndian );
+   while( !in.atEnd() )
+   {
+      quint8 type = 0;
+      qint64 usec = 0;
+      Event  event;
+      in >> type >> usec >> event.payload;
+      if( in.status() != QDataStream::Ok )
+      {
+         wlog( "journal ${f} ends with a truncated event", ("f",journal_file.toStdString()) );
+         break;
+      }
+      event.type = EventType( type );
+      event.usec = usec;
+      events.push_back( event );
+   }
+   return true;
+}
+
+bts::bitchat::decrypted_message EventJournal::decodeReceived( const Event& event )
+{
+   fc::datastream<const char*> ds( event.payload.constData(), event.payload.size() );
+   bts::bitchat::decrypted_message msg;
+   fc::raw::unpack( ds, msg );
+   fc::raw::unpack( ds, msg.from_key );
+   return msg;
+}
+
+std::vector<bts::addressbook::wallet_contact> EventJournal::decodeContactList( const Event& event )
+{
+   fc::datastream<const char*> ds( event.payload.constData(), event.payload.size() );
+   std::vector<bts::addressbook::wallet_contact> contacts;
+   fc::raw::unpack( ds, contacts );
+   return contacts;
+}
+
+bts::addressbook::wallet_contact EventJournal::decodeContactStored( const Event& event )
+{
+   fc::datastream<const char*> ds( event.payload.constData(), event.payload.size() );
+   bts::addressbook::wallet_contact contact;
+   fc::raw::unpack( ds, contact );
+   return contact;
+}
+
+std::pair<std::string,std::string> EventJournal::decodeChatSent( const Event& event )
+{
+   fc::datastream<const char*> ds( event.payload.constData(), event.payload.size() );
+   std::pair<std::string,std::string> chat;
+   fc::raw::unpack( ds, chat.first );
+   fc::raw::unpack( ds, chat.second );
+   return chat;
+}
+
+std::pair< std::vector<std::string>, bts::bitchat::private_email_message > EventJournal::decodeMailSent( const Event& event )
+{
+   fc::datastream<const char*> ds( event.payload.constData(), event.payload.size() );
+   std::pair< std::vector<std::string>, bts::bitchat::private_email_message > mail;
+   fc::raw::unpack( ds, mail.first );
+   fc::raw::unpack( ds, mail.second );
+   return mail;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <bts/addressbook/addressbook.hpp>
+#include <bts/bitchat/bitchat_private_message.hpp>
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QString>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ *  Binary journal of what drove the GUI: delegate callbacks, contact stores
+ *  and sends, each stamped with its offset from the start of recording
+ *  (--record=<file>).  JournalReplayer feeds a journal back into a main window.
+ *
+ *  File layout, QDataStream little endian:
+ *     "KHJ" version(quint8)
+ *     { type(quint8) usec(qint64) payload(QByteArray) }*
+ *  where payload is the fc::raw packing of the event's fields.
+ *
+ *  The first event is the address book as it was when recording started, so
+ *  a replay resolves senders the way the recording session did.
+ *
+ *  WARNING: a journal holds decrypted messages, mail and contacts in the
+ *  clear.  It is created readable by the owner only, but anyone who gets the
+ *  file can read every conversation recorded in it; delete journals once
+ *  they have served their purpose and never attach them to bug reports.
+ */
+class EventJournal
+{
+  public:
+     enum EventType
+     {
+        ReceivedText  = 1,
+        ReceivedEmail = 2,
+        ContactStored = 3,
+        ChatSent      = 4,
+        MailSent      = 5,
+        ContactList   = 6
+     };
+
+     struct Event
+     {
+        EventType  type;
+        int64_t    usec;
+        QByteArray payload;
+     };
+
+     static EventJournal& instance();
+     ~EventJournal();
+
+     bool startRecording( const QString& journal_file );
+     void stopRecording();
+     bool isRecording()const { return !!_file; }
+
+     void recordReceived( EventType type, const bts::bitchat::decrypted_message& msg );
+     void recordContactList( const std::vector<bts::addressbook::wallet_contact>& contacts );
+     void recordContactStored( const bts::addressbook::wallet_contact& contact );
+     void recordChatSent( const std::string& to_dac_id, const std::string& text );
+     void recordMailSent( const std::vector<std::string>& to_dac_ids, const bts::bitchat::private_email_message& mail );
+
+     /** reads every event of a journal, false if it isn't one */
+     static bool read( const QString& journal_file, std::vector<Event>& events );
+
+     static bts::bitchat::decrypted_message   decodeReceived( const Event& event );
+     static std::vector<bts::addressbook::wallet_contact> decodeContactList( const Event& event );
+     static bts::addressbook::wallet_contact  decodeContactStored( const Event& event );
+     static std::pair<std::string,std::string> decodeChatSent( const Event& event );
+     static std::pair< std::vector<std::string>, bts::bitchat::private_email_message > decodeMailSent( const Event& event );
+
+  private:
+     EventJournal();
+     void write( EventType type, const std::vector<char>& payload );
+
+     std::unique_ptr<QFile> _file;
+     QElapsedTimer          _clock;
+};
@@ -0,0 +1,154 @@
+#include "FcEventLoopBridge.hpp"
+#include "MetricsRegistry.hpp"
+
+#include <fc/thread/thread.hpp>
+#include <fc/time.hpp>
+
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
+#include <QEvent>
+
+#include <algorithm>
+
+namespace
+{
+   const QEvent::Type WakeEventType = QEvent::Type( QEvent::User + 31 );
+
+   const int     MinIdleIntervalMs  = 1;
+   /// our sleeping or waiting tasks never wait more than a frame once runnable
+   const int     MaxIdleIntervalMs  = 16;
+   /// with none of our work outstanding, work bts schedules on its own is polled for,
+   /// backing off from a frame while passes find nothing to run
+   const int     MinUntrackedIntervalMs = 16;
+   const int     MaxUntrackedIntervalMs = 1000;
+   /// fc::yield() with nothing runnable returns in a few microseconds, a longer pass ran tasks
+   const int64_t ActivePassUs = 50;
+
+   FcEventLoopBridge*    gBridge = nullptr;
+   std::atomic<int>      gPendingWork( 0 );
+   /// bumped when one of our tasks starts or ends, a pass that didn't bump it ran bts work
+   std::atomic<unsigned> gTrackedActivity( 0 );
+}
+
+FcEventLoopBridge::PendingWork::PendingWork()
+{
+   ++gPendingWork;
+   wake();
+}
+
+FcEventLoopBridge::PendingWork::~PendingWork()
+{
+   --gPendingWork;
+   ++gTrackedActivity;
+   wake();
+}
+
+void FcEventLoopBridge::PendingWork::started()
+{
+   ++gTrackedActivity;
+}
+
+int FcEventLoopBridge::pendingWork()
+{
+   return gPendingWork;
+}
+
+FcEventLoopBridge::FcEventLoopBridge( QObject* parent )
+:QObject(parent),
+ _idle_interval_ms(MinIdleIntervalMs),
+ _untracked_interval_ms(MinUntrackedIntervalMs),
+ _running_tasks(false),
+ _wake_pending(false)
+{
+   _idle_timer.setSingleShot(true);
+   connect( &_idle_timer, &QTimer::timeout, [=](){ runFcTasks(); } );
+}
+
+FcEventLoopBridge::~FcEventLoopBridge()
+{
+   stop();
+}
+
+void FcEventLoopBridge::start()
+{
+   gBridge = this;
+   connect( QAbstractEventDispatcher::instance(), &QAbstractEventDispatcher::aboutToBlock,
+            this, &FcEventLoopBridge::runFcTasks );
+   _idle_timer.start( 0 );
+}
+
+void FcEventLoopBridge::stop()
+{
+   if( gBridge == this )
+      gBridge = nullptr;
+   _idle_timer.stop();
+   if( QAbstractEventDispatcher::instance() )
+   {
+      disconnect( QAbstractEventDispatcher::instance(), &QAbstractEventDispatcher::aboutToBlock,
+                  this, &FcEventLoopBridge::runFcTasks );
+   }
+}
+
+void FcEventLoopBridge::wake()
+{
+   FcEventLoopBridge* bridge = gBridge;
+   if( bridge && !bridge->_wake_pending.exchange(true) )
+   {
+      QCoreApplication::postEvent( bridge, new QEvent( WakeEventType ) );
+   }
+}
+
+void FcEventLoopBridge::customEvent( QEvent* event )
+{
+   if( event->type() == WakeEventType )
+   {
+      _wake_pending = false;
+      _idle_interval_ms = MinIdleIntervalMs;
+      runFcTasks();
+      return;
+   }
+   QObject::customEvent( event );
+}
+
+void FcEventLoopBridge::runFcTasks()
+{
+   // fc tasks may spin a nested Qt event loop (dialogs), don't re-enter from it
+   if( _running_tasks )
+      return;
+   _running_tasks = true;
+
+   static Metric& passes   = MetricsRegistry::instance().counter( "fc.passes" );
+   static Metric& yield_us = MetricsRegistry::instance().gauge( "fc.yield_us" );
+   static Metric& pending  = MetricsRegistry::instance().gauge( "fc.pending_tasks" );
+
+   unsigned tracked_activity = gTrackedActivity;
+   auto     start = fc::time_point::now();
+   fc::yield();
+   int64_t pass_us = (fc::time_point::now() - start).count();
+   passes.add();
+   yield_us.set( pass_us );
+   pending.set( gPendingWork );
+
+   // bts work tends to come in bursts (a sync, a conversation), look again soon after one
+   if( pass_us >= ActivePassUs && tracked_activity == gTrackedActivity )
+      _untracked_interval_ms = MinUntrackedIntervalMs;
+
+   _running_tasks = false;
+   scheduleIdlePoll();
+}
+
+void FcEventLoopBridge::scheduleIdlePoll()
+{
+   if( gPendingWork == 0 )
+   {
+      if( _idle_timer.isActive() && _idle_timer.interval() <= _untracked_interval_ms )
+         return;
+      _idle_timer.start( _untracked_interval_ms );
+      _untracked_interval_ms = std::min( _untracked_interval_ms * 2, MaxUntrackedIntervalMs );
+      return;
+   }
+   if( _idle_timer.isActive() && _idle_timer.interval() <= _idle_interval_ms )
+      return;
+   _idle_timer.start( _idle_interval_ms );
+   _idle_interval_ms = std::min( _idle_interval_ms * 2, MaxIdleIntervalMs );
+}
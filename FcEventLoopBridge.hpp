@@ -0,0 +1,78 @@
+#pragma once
+#include <QObject>
+#include <QTimer>
+
+#include <fc/thread/thread.hpp>
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+/**
+ *  Runs fc tasks from inside the Qt event loop without ever sleeping on the
+ *  GUI thread.
+ *
+ *  Pending fc work is drained with fc::yield() right before Qt blocks for
+ *  events and whenever wake() is called (from any thread).  fc gives no
+ *  signal when a sleeping or waiting task becomes runnable, so work started
+ *  through FcEventLoopBridge::async() is counted: while any of it is
+ *  outstanding the bridge polls, backing off to one frame, and each task
+ *  wakes the bridge when it is posted and when it ends.  Only use async()
+ *  for work that finishes; something that runs for the life of a window
+ *  would keep the bridge polling, post a short task per tick instead.
+ *
+ *  Tasks bts schedules on this thread itself (network reads completed by
+ *  fc's I/O thread) are invisible until a pass runs them.  fc doesn't tell
+ *  anyone outside the scheduler that they were queued, so the bridge checks
+ *  for them a frame after any pass that ran something and backs off to once
+ *  a second while passes stay empty; an idle window wakes once a second.
+ */
+class FcEventLoopBridge : public QObject
+{
+  public:
+     FcEventLoopBridge( QObject* parent = nullptr );
+     ~FcEventLoopBridge();
+
+     void start();
+     void stop();
+
+     /**
+      *  Thread safe.  Posts an event that runs pending fc tasks as soon as the
+      *  GUI thread gets back to its event loop; posting to the event loop is
+      *  what wakes Qt's dispatcher (eventfd / pipe on unix).
+      */
+     static void wake();
+
+     /** fc::async on this thread's scheduler, counted as outstanding work until the task is done */
+     template<typename Functor>
+     static fc::future< decltype( std::declval<Functor>()() ) > async( Functor functor )
+     {
+        // released with the task, whether it ran or was cancelled
+        auto pending = std::make_shared<PendingWork>();
+        return fc::async( [functor, pending](){ pending->started(); return functor(); } );
+     }
+
+     /** number of async() tasks posted and not yet done */
+     static int pendingWork();
+
+  protected:
+     virtual void customEvent( QEvent* event );
+
+  private:
+     class PendingWork
+     {
+       public:
+          PendingWork();
+          ~PendingWork();
+          void started();
+     };
+
+     void runFcTasks();
+     void scheduleIdlePoll();
+
+     QTimer             _idle_timer;
+     int                _idle_interval_ms;
+     int                _untracked_interval_ms;
+     bool               _running_tasks;
+     std::atomic<bool>  _wake_pending;
+};
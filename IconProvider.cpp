@@ -0,0 +1,197 @@
+#include "IconProvider.hpp"
+#include "MetricsRegistry.hpp"
+#include "Trace.hpp"
+
+#include <QApplication>
+#include <QFileInfo>
+#include <QHash>
+#include <QIconEngine>
+#include <QImageReader>
+#include <QPainter>
+#include <QPixmapCache>
+#include <QRegularExpression>
+#include <QStyle>
+#include <QStyleOption>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace
+{
+   struct Variant
+   {
+      QString path;
+      /// read from the image header, nothing is decoded to get it
+      QSize   size;
+   };
+
+   /** variants of one resource image, smallest first, found on first use */
+   class VariantSet
+   {
+     public:
+        VariantSet( const QString& resource_path ):_path(resource_path),_scanned(false){}
+
+        const std::vector<Variant>& variants()
+        {
+           if( !_scanned )
+              scan();
+           return _variants;
+        }
+
+        /** the smallest variant at least as large as size in both directions, else the largest */
+        const Variant* pick( const QSize& size )
+        {
+           auto& all = variants();
+           for( auto itr = all.begin(); itr != all.end(); ++itr )
+           {
+              if( itr->size.width() >= size.width() && itr->size.height() >= size.height() )
+                 return &*itr;
+           }
+           return all.empty() ? nullptr : &all.back();
+        }
+
+        /** the natural size of the icon, ie: its largest variant */
+        QSize largestSize()
+        {
+           auto& all = variants();
+           return all.empty() ? QSize() : all.back().size;
+        }
+
+     private:
+        void addVariant( const QString& path )
+        {
+           if( !QFileInfo( path ).exists() )
+              return;
+           QImageReader reader( path );
+           Variant variant;
+           variant.path = path;
+           variant.size = reader.size();
+           if( variant.size.isValid() )
+              _variants.push_back( variant );
+        }
+
+        void scan()
+        {
+           _scanned = true;
+           QFileInfo info( _path );
+           addVariant( _path );
+           // a path already inside a size directory has its siblings next to that directory
+           QString base_dir = info.path();
+           static const QRegularExpression size_dir( "^\\d+x\\d+$" );
+           if( size_dir.match( QFileInfo( base_dir ).fileName() ).hasMatch() )
+              base_dir = QFileInfo( base_dir ).path();
+           const int sizes[] = { 16, 24, 32, 48, 64, 128, 256 };
+           for( int size : sizes )
+           {
+              QString sibling = QString( "%1/%2x%2/%3" ).arg( base_dir ).arg( size ).arg( info.fileName() );
+              if( sibling != _path )
+                 addVariant( sibling );
+           }
+           addVariant( QString( "%1/%2@2x.%3" ).arg( info.path() ).arg( info.completeBaseName() ).arg( info.suffix() ) );
+           std::sort( _variants.begin(), _variants.end(), []( const Variant& a, const Variant& b ){
+                         return a.size.width() * a.size.height() < b.size.width() * b.size.height(); } );
+        }
+
+        QString              _path;
+        bool                 _scanned;
+        std::vector<Variant> _variants;
+   };
+
+   typedef std::shared_ptr<VariantSet> VariantSetPtr;
+
+   class LazyIconEngine : public QIconEngine
+   {
+     public:
+        LazyIconEngine( const VariantSetPtr& variants ):_variants(variants){}
+
+        virtual void paint( QPainter* painter, const QRect& rect, QIcon::Mode mode, QIcon::State state )
+        {
+           qreal device_pixel_ratio = painter->device()->devicePixelRatio();
+           QPixmap icon_pixmap = pixmap( rect.size() * device_pixel_ratio, mode, state );
+           if( icon_pixmap.isNull() )
+              return;
+           QSize  logical_size = icon_pixmap.size() / device_pixel_ratio;
+           QPoint top_left( rect.x() + (rect.width() - logical_size.width()) / 2,
+                            rect.y() + (rect.height() - logical_size.height()) / 2 );
+           painter->drawPixmap( QRect( top_left, logical_size ), icon_pixmap );
+        }
+
+        virtual QSize actualSize( const QSize& size, QIcon::Mode, QIcon::State )
+        {
+           // like the default engine: scale down to fit, never up
+           QSize natural = _variants->largestSize();
+           if( !natural.isValid() )
+              return QSize();
+           if( natural.width() <= size.width() && natural.height() <= size.height() )
+              return natural;
+           return natural.scaled( size, Qt::KeepAspectRatio );
+        }
+
+        virtual QPixmap pixmap( const QSize& size, QIcon::Mode mode, QIcon::State state )
+        {
+           QSize target = actualSize( size, mode, state );
+           const Variant* variant = _variants->pick( target );
+           if( !variant || target.isEmpty() )
+              return QPixmap();
+
+           QString key = QString( "kh_icon:%1:%2x%3:%4" ).arg( variant->path ).arg( target.width() )
+                                                         .arg( target.height() ).arg( int(mode) );
+           static Metric& hits   = MetricsRegistry::instance().counter( "icon_cache.hits" );
+           static Metric& misses = MetricsRegistry::instance().counter( "icon_cache.misses" );
+           QPixmap cached;
+           if( QPixmapCache::find( key, &cached ) )
+           {
+              hits.add();
+              return cached;
+           }
+           misses.add();
+
+           KH_TRACE_SCOPE( "IconProvider::decode" );
+           QImageReader reader( variant->path );
+           if( variant->size != target )
+              reader.setScaledSize( target );
+           QPixmap decoded = QPixmap::fromImage( reader.read() );
+           if( mode != QIcon::Normal && !decoded.isNull() )
+           {
+              QStyleOption option;
+              option.palette = QApplication::palette();
+              decoded = QApplication::style()->generatedIconPixmap( mode, decoded, &option );
+           }
+           QPixmapCache::insert( key, decoded );
+           return decoded;
+        }
+
+        virtual QIconEngine* clone()const
+        {
+           return new LazyIconEngine( _variants );
+        }
+
+        virtual QString key()const
+        {
+           return "LazyIconEngine";
+        }
+
+     private:
+        VariantSetPtr _variants;
+   };
+}
+
+QIcon IconProvider::icon( const QString& resource_path )
+{
+   // icons are implicitly shared, handing out the same one shares the engine as well
+   static QHash<QString,QIcon> icons;
+   auto itr = icons.find( resource_path );
+   if( itr != icons.end() )
+      return *itr;
+   QIcon new_icon( new LazyIconEngine( std::make_shared<VariantSet>( resource_path ) ) );
+   icons.insert( resource_path, new_icon );
+   return new_icon;
+}
+
+QIcon IconProvider::themeIcon( const QString& theme_name, const QString& resource_path )
+{
+   if( QIcon::hasThemeIcon( theme_name ) )
+      return QIcon::fromTheme( theme_name );
+   return icon( resource_path );
+}
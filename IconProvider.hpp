@@ -0,0 +1,23 @@
+#pragma once
+#include <QIcon>
+#include <QString>
+
+/**
+ *  Icons for images bundled in Keyhotee.qrc.
+ *
+ *  Nothing is read when an icon is created.  The first time it is painted (or
+ *  a pixmap is asked for) the smallest variant that covers the requested size
+ *  at the device pixel ratio is decoded, scaled and kept in QPixmapCache, so
+ *  every widget showing the same icon at the same size shares one pixmap.
+ *
+ *  Variants of ":/images/name.png" are looked up as ":/images/NxN/name.png"
+ *  and ":/images/name@2x.png".
+ */
+class IconProvider
+{
+  public:
+     /** the same QIcon is returned for every call with the same path */
+     static QIcon icon( const QString& resource_path );
+     /** the theme's icon if it has one, otherwise the lazy resource icon */
+     static QIcon themeIcon( const QString& theme_name, const QString& resource_path );
+};
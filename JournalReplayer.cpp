@@ -0,0 +1,163 @@
+#include "JournalReplayer.hpp"
+#include "KeyhoteeMainWindow.hpp"
+#include "AddressBook/AddressBookModel.hpp"
+#include "FcEventLoopBridge.hpp"
+#include "Trace.hpp"
+
+#include <bts/application.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <QApplication>
+#include <QPointer>
+
+#include <algorithm>
+
+JournalReplayer::JournalReplayer( KeyhoteeMainWindow& window, const QString& journal_file, bool fast, QObject* parent )
+:QObject(parent),
+ _window(window),
+ _journal_file(journal_file),
+ _fast(fast),
+ _next_event(0),
+ _total_lag_us(0),
+ _max_lag_us(0)
+{
+   _timer.setSingleShot(true);
+   connect( &_timer, &QTimer::timeout, [=](){
+      replay( _events[_next_event++] );
+      scheduleNext();
+   } );
+}
+
+void JournalReplayer::start()
+{
+   if( !EventJournal::read( _journal_file, _events ) )
+   {
+      elog( "${f} is not an event journal", ("f",_journal_file.toStdString()) );
+      qApp->quit();
+      return;
+   }
+   ilog( "replaying ${n} events from ${f}", ("n",_events.size())("f",_journal_file.toStdString()) );
+   // the address book goes in before any event that might refer to it
+   std::stable_partition( _events.begin(), _events.end(),
+                          []( const EventJournal::Event& e ){ return e.type == EventJournal::ContactList; } );
+
+   QPointer<JournalReplayer> self(this);
+   FcEventLoopBridge::async( [=](){
+      while( self && !self->_window.contactsLoaded() )
+         fc::usleep( fc::milliseconds( 100 ) );
+      if( self )
+      {
+         self->_clock.start();
+         self->scheduleNext();
+      }
+   } );
+}
+
+void JournalReplayer::scheduleNext()
+{
+   if( _next_event >= _events.size() )
+   {
+      finish();
+      return;
+   }
+   if( _fast )
+   {
+      // one event per pass of the event loop so flush timers and repaints still get to run
+      _timer.start(0);
+      return;
+   }
+   qint64 due_us = _events[_next_event].usec - _clock.nsecsElapsed() / 1000;
+   _timer.start( int( std::max<qint64>( 0, due_us / 1000 ) ) );
+}
+
+void JournalReplayer::replay( const EventJournal::Event& event )
+{
+   if( !_fast )
+   {
+      qint64 lag_us = _clock.nsecsElapsed() / 1000 - event.usec;
+      _total_lag_us += std::max<qint64>( 0, lag_us );
+      _max_lag_us    = std::max( _max_lag_us, lag_us );
+   }
+
+   try {
+      switch( event.type )
+      {
+         case EventJournal::ReceivedText:
+            _window.injectReceivedText( EventJournal::decodeReceived( event ) );
+            break;
+         case EventJournal::ReceivedEmail:
+            _window.injectReceivedEmail( EventJournal::decodeReceived( event ) );
+            break;
+         case EventJournal::ContactList:
+         {
+            KH_TRACE_SCOPE( "replay.contactList" );
+            auto contacts = EventJournal::decodeContactList( event );
+            for( auto itr = contacts.begin(); itr != contacts.end(); ++itr )
+            {
+               storeContact( *itr );
+            }
+            break;
+         }
+         case EventJournal::ContactStored:
+         {
+            KH_TRACE_SCOPE( "replay.storeContact" );
+            storeContact( EventJournal::decodeContactStored( event ) );
+            break;
+         }
+         case EventJournal::ChatSent:
+         {
+            KH_TRACE_SCOPE( "replay.chatSent" );
+            auto chat    = EventJournal::decodeChatSent( event );
+            auto contact = bts::application::instance()->get_profile()->get_addressbook()->get_contact_by_dac_id( chat.first );
+            if( contact.valid() )
+            {
+               _window.createContactGuiIfNecessary( contact->wallet_index )->receiveChatMessage(
+                  "me", QString::fromStdString( chat.second ), QDateTime::currentDateTime() );
+            }
+            break;
+         }
+         case EventJournal::MailSent:
+         {
+            auto mail = EventJournal::decodeMailSent( event );
+            ilog( "replay: mail to ${n} recipients not sent", ("n",mail.first.size()) );
+            break;
+         }
+         default:
+            wlog( "replay: skipping unknown event type ${t}", ("t",int(event.type)) );
+      }
+   }
+   catch ( const fc::exception& e )
+   {
+      wlog( "replay: event ${i} failed: ${e}", ("i",_next_event - 1)("e",e.to_detail_string()) );
+   }
+}
+
+void JournalReplayer::storeContact( const bts::addressbook::wallet_contact& recorded_contact )
+{
+   Contact contact( recorded_contact );
+   // indices from the recording profile mean nothing here, match contacts by dac id
+   auto existing = bts::application::instance()->get_profile()->get_addressbook()->get_contact_by_dac_id( contact.dac_id_string );
+   contact.wallet_index = existing.valid() ? existing->wallet_index : WALLET_INVALID_INDEX;
+   _window.addressBookModel()->storeContact( contact );
+}
+
+void JournalReplayer::finish()
+{
+   double elapsed_ms = _clock.nsecsElapsed() / 1e6;
+   double recorded_ms = _events.empty() ? 0.0 : _events.back().usec / 1e3;
+   if( _fast )
+   {
+      ilog( "replay: ${n} events in ${e} ms (recorded over ${r} ms)",
+            ("n",_events.size())("e",elapsed_ms)("r",recorded_ms) );
+   }
+   else
+   {
+      ilog( "replay: ${n} events in ${e} ms, lag avg ${a} ms max ${m} ms",
+            ("n",_events.size())("e",elapsed_ms)
+            ("a",_events.empty() ? 0.0 : _total_lag_us / 1e3 / _events.size())("m",_max_lag_us / 1e3) );
+   }
+   // leave a pass of the event loop for the last chat flush before quitting
+   QTimer::singleShot( 100, qApp, SLOT(quit()) );
+}
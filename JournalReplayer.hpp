@@ -0,0 +1,52 @@
+#pragma once
+#include "EventJournal.hpp"
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+#include <vector>
+
+class KeyhoteeMainWindow;
+
+/**
+ *  Feeds an EventJournal back into a main window (--replay=<file>[,fast]).
+ *
+ *  Received messages go through the application delegate and contact stores
+ *  through the address book model, exactly as they did when recorded.  Sends
+ *  are only shown in the contact's chat, nothing goes out to the network.
+ *
+ *  Events are replayed at their recorded offsets, or back to back in fast
+ *  mode.  The application quits once the journal is exhausted, run it with
+ *  --trace (or look at logs/replay_trace.json) to compare builds.
+ *
+ *  The address book recorded at the start of the journal is stored first,
+ *  before anything else is replayed.  Replayed contacts overwrite the
+ *  profile's, so main() only starts a replay for a profile whose name starts
+ *  with "scratch".
+ */
+class JournalReplayer : public QObject
+{
+  public:
+     JournalReplayer( KeyhoteeMainWindow& window, const QString& journal_file, bool fast, QObject* parent = nullptr );
+
+     /** waits for the address book to load then starts replaying */
+     void start();
+
+  private:
+     void scheduleNext();
+     void replay( const EventJournal::Event& event );
+     void storeContact( const bts::addressbook::wallet_contact& recorded_contact );
+     void finish();
+
+     KeyhoteeMainWindow&              _window;
+     QString                          _journal_file;
+     bool                             _fast;
+     std::vector<EventJournal::Event> _events;
+     size_t                           _next_event;
+     QTimer                           _timer;
+     QElapsedTimer                    _clock;
+     /// how far behind the recorded offsets replay fell, summed over all events
+     qint64                           _total_lag_us;
+     qint64                           _max_lag_us;
+};
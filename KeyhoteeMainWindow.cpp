@@ -4,6 +4,14 @@
 #include "AddressBook/ContactView.hpp"
 #include "Mail/MailEditor.hpp"
 #include "Mail/InboxModel.hpp"
+#include "AsyncLog.hpp"
+#include "EventJournal.hpp"
+#include "FcEventLoopBridge.hpp"
+#include "IconProvider.hpp"
+#include "MetricsRegistry.hpp"
+#include "MiningScheduler.hpp"
+#include "PerfHud.hpp"
+#include "Trace.hpp"
 #include <bts/application.hpp>
 #include <bts/bitchat/bitchat_private_message.hpp>
 
@@ -13,9 +21,19 @@
 
 #include <fc/reflect/variant.hpp>
 #include <fc/log/logger.hpp>
+#include <fc/thread/thread.hpp>
 
+#include <QActionGroup>
+#include <QElapsedTimer>
+#include <QLabel>
 #include <QLineEdit>
+#include <QMenuBar>
 #include <QCompleter>
+#include <QPointer>
+#include <QStatusBar>
+#include <QTimer>
+
+#include <map>
 
 extern std::string gApplication_name;
 extern std::string gProfile_name;
@@ -47,6 +65,12 @@ enum MailboxChildren
     Drafts,
     Sent
 };
+enum
+{
+    /// number of ContactView widgets kept alive and rebound between contacts
+    MaxContactViews = 4
+};
+
 enum SidebarItemTypes
 {
     IdentityItem = 2,
@@ -62,22 +86,37 @@ void ContactGui::setUnreadMsgCount(unsigned int count)
 
 bool ContactGui::isChatVisible() 
 { 
-    return GetKeyhoteeWindow()->isSelectedContactGui(this) && _view->isChatSelected(); 
+    return _view && GetKeyhoteeWindow()->isSelectedContactGui(this) && _view->isChatSelected(); 
 }
 
 void ContactGui::receiveChatMessage( const QString& from, const QString& msg, const QDateTime& dateTime)
 {
-    _view->appendChatMessage(from,msg,dateTime);
+    receiveChatMessages( std::vector<ChatTranscript::Entry>( 1, ChatTranscript::Entry( from, msg, dateTime, from == "me" ) ) );
+}
+
+void ContactGui::receiveChatMessages( const std::vector<ChatTranscript::Entry>& entries )
+{
+    if (_view)
+      {
+      _view->appendChatMessages(entries);
+      }
+    else
+      { //not on screen, the view picks the lines up from the transcript once bound
+      if (!_transcript)
+        _transcript = ChatTranscript::openForContact(_dac_id);
+      if (_transcript)
+        _transcript->append(entries);
+      }
     if (!isChatVisible())
       {
-      setUnreadMsgCount(_unread_msg_count+1);
+      setUnreadMsgCount(_unread_msg_count+entries.size());
       }
 }
 
 void ContactGui::updateTreeItemDisplay()
 {
     QString display_text;
-    QString name = _view->getContact().getLabel();
+    QString name = _label;
     if (_unread_msg_count)
       display_text = QString("%1 (%2)").arg(name).arg(_unread_msg_count);
     else
@@ -86,17 +125,31 @@ void ContactGui::updateTreeItemDisplay()
 }
 
 
+/**
+ *  Receives messages from the network.  Inbound chat is not delivered one
+ *  message at a time, messages are grouped per contact and handed to the GUI
+ *  once per frame so a burst costs one append and one sidebar update per contact.
+ */
 class ApplicationDelegate : public bts::application_delegate
 {
     public:
      KeyhoteeMainWindow& _main_window;
      ApplicationDelegate( KeyhoteeMainWindow& window )
-     :_main_window(window)
+     :_main_window(window),
+      _chat_received( MetricsRegistry::instance().counter( "chat.received" ) ),
+      _chat_pending( MetricsRegistry::instance().gauge( "chat.inbound_pending" ) )
      {
+        _chat_flush_timer.setSingleShot(true);
+        _chat_flush_timer.setInterval(ChatFlushIntervalMs);
+        QObject::connect( &_chat_flush_timer, &QTimer::timeout, [=](){ flushPendingChat(); } );
      }
 
      virtual void received_text( const bts::bitchat::decrypted_message& msg)
      {
+        KH_TRACE_SCOPE( "received_text" );
+        // bts is busy receiving, more of its work is likely queued behind this message
+        FcEventLoopBridge::wake();
+        EventJournal::instance().recordReceived( EventJournal::ReceivedText, msg );
         auto opt_contact = _main_window._addressbook->get_contact_by_public_key( *(msg.from_key) );
         if( !opt_contact )
         {
@@ -104,18 +157,60 @@ class ApplicationDelegate : public bts::application_delegate
         }
         else
         {
-            wlog( "Received text from known contact!" );
-            auto contact_gui = _main_window.createContactGuiIfNecessary( opt_contact->wallet_index );
+            KH_DLOG( "Received text from known contact!" );
             auto text = msg.as<bts::bitchat::private_text_message>();
             QDateTime dateTime;
             dateTime.setTime_t(msg.sig_time.sec_since_epoch());
-            contact_gui->receiveChatMessage( opt_contact->dac_id_string.c_str(), text.msg.c_str(), dateTime );
+            _pending_chat[opt_contact->wallet_index].push_back( 
+                ChatTranscript::Entry( opt_contact->dac_id_string.c_str(), text.msg.c_str(), dateTime, false ) );
+            _chat_received.add();
+            _chat_pending.add();
+            if( !_chat_flush_timer.isActive() )
+            {
+                _chat_flush_timer.start();
+            }
         }
      }
 
      virtual void received_email( const bts::bitchat::decrypted_message& msg)
      {
+        KH_TRACE_SCOPE( "received_email" );
+        FcEventLoopBridge::wake();
+        EventJournal::instance().recordReceived( EventJournal::ReceivedEmail, msg );
+        static Metric& mail_received = MetricsRegistry::instance().counter( "mail.received" );
+        mail_received.add();
+     }
+
+     void flushPendingChat()
+     {
+        if( !_main_window._contacts_loaded )
+        {
+            // senders can't be mapped to contact guis yet, hold on to the messages
+            _chat_flush_timer.start();
+            return;
+        }
+        std::map< int, std::vector<ChatTranscript::Entry> > pending;
+        pending.swap( _pending_chat );
+        for( auto itr = pending.begin(); itr != pending.end(); ++itr )
+        {
+            auto contact_gui = _main_window.createContactGuiIfNecessary( itr->first );
+            contact_gui->receiveChatMessages( itr->second );
+            _chat_pending.add( -int64_t(itr->second.size()) );
+            if( _main_window._chat_delivered_observer )
+            {
+                _main_window._chat_delivered_observer( itr->first, itr->second.size() );
+            }
+        }
      }
+
+    private:
+     enum { ChatFlushIntervalMs = 16 };
+
+     std::map< int, std::vector<ChatTranscript::Entry> >  _pending_chat;
+     QTimer                                               _chat_flush_timer;
+     Metric&                                              _chat_received;
+     /// received but not yet handed to a ContactGui
+     Metric&                                              _chat_pending;
 };
 
 QAbstractItemModel* modelFromFile(const QString& fileName, QCompleter* completer)
@@ -143,12 +238,15 @@ QAbstractItemModel* modelFromFile(const QString& fileName, QCompleter* completer
 }
 
 KeyhoteeMainWindow::KeyhoteeMainWindow()
- : QMainWindow()
+ : QMainWindow(),
+   _contacts_loaded(false),
+   _warming_mail_editors(false)
 {
+    KH_TRACE_SCOPE( "KeyhoteeMainWindow::KeyhoteeMainWindow" );
     _app_delegate.reset( new ApplicationDelegate(*this) );
     ui.reset( new Ui::KeyhoteeMainWindow() );
     ui->setupUi(this);
-    setWindowIcon( QIcon( ":/images/shield1024.png" ) );
+    setWindowIcon( IconProvider::icon( ":/images/shield1024.png" ) );
     if (gProfile_name != "default")
     {
       QString title =QString("%1 (%2)").arg(gApplication_name.c_str()).arg(gProfile_name.c_str());
@@ -163,7 +261,7 @@ KeyhoteeMainWindow::KeyhoteeMainWindow()
     ui->side_bar->setAttribute(Qt::WA_MacShowFocusRect, 0);
     QApplication::setWindowIcon( QIcon( ":/images/shield1024.icns" ) );
 #else
-    QApplication::setWindowIcon( QIcon( ":/images/shield1024.png" ) );
+    QApplication::setWindowIcon( IconProvider::icon( ":/images/shield1024.png" ) );
 #endif
 
     QWidget* empty = new QWidget();
@@ -219,14 +317,31 @@ KeyhoteeMainWindow::KeyhoteeMainWindow()
     _wallets_root->setExpanded(true);
 
     auto app    = bts::application::instance();
-    app->set_application_delegate( _app_delegate.get() );
     auto profile    = app->get_profile();
-    auto idents = profile->identities();
 
-    _inbox  = new InboxModel(this,profile);
+    // a replay needs the contacts before any message that refers to them
+    if( EventJournal::instance().isRecording() )
+    {
+        const auto& journal_contacts = profile->get_addressbook()->get_contacts();
+        std::vector<bts::addressbook::wallet_contact> contact_list;
+        contact_list.reserve( journal_contacts.size() );
+        for( auto itr = journal_contacts.begin(); itr != journal_contacts.end(); ++itr )
+        {
+            contact_list.push_back( itr->second );
+        }
+        EventJournal::instance().recordContactList( contact_list );
+    }
+    app->set_application_delegate( _app_delegate.get() );
+
+    // chat history is only readable with this profile's keychain
+    auto transcript_secret = profile->get_keychain().get_identity_key( "keyhotee.chat_transcripts" ).get_secret();
+    ChatTranscript::setStorageKey( fc::sha512::hash( transcript_secret.data(), sizeof(transcript_secret) ) );
+
+    // both models start empty and are filled by loadModels() once the window is up
+    _inbox  = new InboxModel( this, profile, false );
 
     auto addressbook = profile->get_addressbook();
-    _addressbook_model  = new AddressBookModel( this, addressbook );
+    _addressbook_model  = new AddressBookModel( this, addressbook, false );
     connect( _addressbook_model, &QAbstractItemModel::dataChanged, this, &KeyhoteeMainWindow::addressBookDataChanged );
 
 
@@ -244,29 +359,14 @@ KeyhoteeMainWindow::KeyhoteeMainWindow()
     ui->sent_box_page->setModel(_inbox, MailInbox::Sent);
 
 
-    ui->actionEnable_Mining->setChecked(app->get_mining_intensity() != 0);
-    wlog( "idents: ${idents}", ("idents",idents) );
-    for( size_t i = 0; i < idents.size(); ++i )
-    {
-    /*
-        auto new_ident_item = new QTreeWidgetItem(_identities_root, (QTreeWidgetItem::ItemType)IdentityItem );
-
-        auto id_rec = app->lookup_name( idents[i].bit_id );
-        if( !id_rec )
-        {
-           new_ident_item->setText( 0, (idents[i].bit_id + " [pending]").c_str() );
-        }
-        else
-        {
-           new_ident_item->setText( 0, (idents[i].bit_id + " [" + std::to_string(id_rec->repute)+"]" ).c_str() );
-        }
-    */
-        app->mine_name( idents[i].dac_id, 
-                        profile->get_keychain().get_identity_key( idents[i].dac_id ).get_public_key(), 
-                        idents[i].mining_effort );
-    }
+    _mining_scheduler = new MiningScheduler(this);
+    ui->actionEnable_Mining->setChecked(_mining_scheduler->isEnabled());
+    setupMiningBudgetMenu();
+    setupPerfHud();
     _addressbook = profile->get_addressbook();
 
+    loadModels();
+
     /*
     auto abook  = profile->get_addressbook();
     auto contacts = abook->get_known_bitnames();
@@ -292,6 +392,113 @@ KeyhoteeMainWindow::~KeyhoteeMainWindow()
 {
 }
 
+namespace
+{
+   /** one thread per model so the inbox and the address book load side by side */
+   fc::thread& inboxLoaderThread()
+   {
+      static fc::thread loader_thread( "inbox_loader" );
+      return loader_thread;
+   }
+
+   fc::thread& contactLoaderThread()
+   {
+      static fc::thread loader_thread( "contact_loader" );
+      return loader_thread;
+   }
+}
+
+/**
+ *  Second startup stage: the window goes up with empty models while the inbox
+ *  headers are read and the contact icons decoded on worker threads.  Each model
+ *  is swapped in from the fc loop once its data is ready, by then the window has
+ *  already been shown and painted.
+ */
+void KeyhoteeMainWindow::loadModels()
+{
+    statusBar()->showMessage( tr("Loading contacts and mail...") );
+
+    auto profile = bts::application::instance()->get_profile();
+
+    // copying the contacts is cheap, decoding their icons is not
+    const auto& loaded_contacts = _addressbook->get_contacts();
+    std::vector<bts::addressbook::wallet_contact> contacts;
+    contacts.reserve( loaded_contacts.size() );
+    for( auto itr = loaded_contacts.begin(); itr != loaded_contacts.end(); ++itr )
+    {
+        contacts.push_back( itr->second );
+    }
+
+    QPointer<KeyhoteeMainWindow> self(this);
+    FcEventLoopBridge::async( [=](){
+        auto inbox_headers = inboxLoaderThread().async( [=](){
+                                 KH_TRACE_SCOPE( "InboxModel::fetchHeaders" );
+                                 return InboxModel::fetchHeaders( profile ); } );
+        auto contacts_snapshot = contactLoaderThread().async( [=](){
+                                 KH_TRACE_SCOPE( "AddressBookModel::loadContacts" );
+                                 return AddressBookModel::loadContacts( contacts ); } );
+
+        try {
+            auto snapshot = contacts_snapshot.wait();
+            if( self )
+                self->_addressbook_model->setContacts( snapshot );
+        }
+        catch ( const fc::exception& e )
+        {
+            elog( "unable to load contacts: ${e}", ("e",e.to_detail_string()) );
+        }
+        if( self )
+            self->_contacts_loaded = true;
+
+        try {
+            auto headers = inbox_headers.wait();
+            if( self )
+                self->_inbox->setHeaders( headers );
+        }
+        catch ( const fc::exception& e )
+        {
+            elog( "unable to load inbox: ${e}", ("e",e.to_detail_string()) );
+        }
+
+        if( self )
+        {
+            self->statusBar()->clearMessage();
+            self->startMining();
+            self->warmMailEditorPool();
+        }
+    } );
+}
+
+/** last startup stage, name mining competes with loading for the CPU */
+void KeyhoteeMainWindow::startMining()
+{
+    KH_TRACE_SCOPE( "KeyhoteeMainWindow::startMining" );
+    auto app     = bts::application::instance();
+    auto profile = app->get_profile();
+    auto idents  = profile->identities();
+    wlog( "idents: ${idents}", ("idents",idents) );
+    for( size_t i = 0; i < idents.size(); ++i )
+    {
+    /*
+        auto new_ident_item = new QTreeWidgetItem(_identities_root, (QTreeWidgetItem::ItemType)IdentityItem );
+
+        auto id_rec = app->lookup_name( idents[i].bit_id );
+        if( !id_rec )
+        {
+           new_ident_item->setText( 0, (idents[i].bit_id + " [pending]").c_str() );
+        }
+        else
+        {
+           new_ident_item->setText( 0, (idents[i].bit_id + " [" + std::to_string(id_rec->repute)+"]" ).c_str() );
+        }
+    */
+        auto public_key = profile->get_keychain().get_identity_key( idents[i].dac_id ).get_public_key();
+        if( !_mining_scheduler->needsMining( idents[i].dac_id, public_key ) )
+            continue;
+        app->mine_name( idents[i].dac_id, public_key, idents[i].mining_effort );
+    }
+}
+
 void KeyhoteeMainWindow::addContact()
 {
    /*
@@ -330,6 +537,7 @@ void KeyhoteeMainWindow::addressBookDataChanged( const QModelIndex& top_left, co
    auto itr = _contact_guis.find( changed_contact.wallet_index );
    if( itr != _contact_guis.end() )
    {
+        itr->second._label = changed_contact.getLabel();
         itr->second.updateTreeItemDisplay();
    }
 }
@@ -399,10 +607,75 @@ void KeyhoteeMainWindow::on_actionExit_triggered()
 }
 
 
+void KeyhoteeMainWindow::injectReceivedText( const bts::bitchat::decrypted_message& msg )
+{
+    _app_delegate->received_text( msg );
+}
+
+void KeyhoteeMainWindow::injectReceivedEmail( const bts::bitchat::decrypted_message& msg )
+{
+    _app_delegate->received_email( msg );
+}
+
+void KeyhoteeMainWindow::setChatDeliveredObserver( std::function<void(int,size_t)> observer )
+{
+    _chat_delivered_observer = observer;
+}
+
 void KeyhoteeMainWindow::enableMining_toggled(bool enabled)
 {
-    auto app    = bts::application::instance();
-    app->set_mining_intensity(enabled ? 100 : 0);
+    _mining_scheduler->setEnabled(enabled);
+}
+
+void KeyhoteeMainWindow::setupMiningBudgetMenu()
+{
+    auto budget_menu  = ui->menuEdit->addMenu( tr("Mining CPU Budget") );
+    auto budget_group = new QActionGroup( budget_menu );
+    const int budgets[] = { 10, 25, 50, 75, 100 };
+    for( int budget : budgets )
+    {
+        auto action = budget_menu->addAction( tr("%1%").arg(budget) );
+        action->setCheckable(true);
+        action->setChecked( budget == _mining_scheduler->cpuBudget() );
+        budget_group->addAction(action);
+        connect( action, &QAction::triggered, [=](){ _mining_scheduler->setCpuBudget(budget); } );
+    }
+
+    auto mining_status = new QLabel( _mining_scheduler->statusText(), this );
+    statusBar()->addPermanentWidget( mining_status );
+    connect( _mining_scheduler, &MiningScheduler::statusChanged, mining_status, &QLabel::setText );
+}
+
+void KeyhoteeMainWindow::setupPerfHud()
+{
+    _perf_hud = new PerfHud(this);
+    addDockWidget( Qt::BottomDockWidgetArea, _perf_hud );
+    _perf_hud->hide();
+
+    auto view_menu  = menuBar()->addMenu( tr("View") );
+    auto hud_action = _perf_hud->toggleViewAction();
+    hud_action->setText( tr("Performance HUD") );
+    hud_action->setShortcut( QKeySequence( Qt::CTRL + Qt::SHIFT + Qt::Key_P ) );
+    view_menu->addAction( hud_action );
+}
+
+bool KeyhoteeMainWindow::event( QEvent* event )
+{
+    if( event->type() != QEvent::UpdateRequest )
+        return QMainWindow::event( event );
+
+    static Metric& frames      = MetricsRegistry::instance().counter( "gui.frames" );
+    static Metric& frame_us    = MetricsRegistry::instance().gauge( "gui.frame_us" );
+    static Metric& frame_max   = MetricsRegistry::instance().gauge( "gui.frame_us_max" );
+    QElapsedTimer paint_clock;
+    paint_clock.start();
+    bool handled = QMainWindow::event( event );
+    int64_t elapsed_us = paint_clock.nsecsElapsed() / 1000;
+    frames.add();
+    frame_us.set( elapsed_us );
+    if( elapsed_us > frame_max.value() )
+        frame_max.set( elapsed_us );
+    return handled;
 }
 
 void KeyhoteeMainWindow::showContacts()
@@ -418,9 +691,58 @@ void KeyhoteeMainWindow::newMailMessage()
 
 void KeyhoteeMainWindow::newMailMessageTo(int contact_id)
 {
-  auto msg_window = new MailEditor(this, _contact_completer);
+  MailEditor* msg_window = nullptr;
+  if( _mail_editor_pool.empty() )
+  {
+     msg_window = createMailEditor();
+  }
+  else
+  {
+     msg_window = _mail_editor_pool.back();
+     _mail_editor_pool.pop_back();
+  }
   msg_window->addToContact(contact_id);
   msg_window->setFocusAndShow();
+  warmMailEditorPool();
+}
+
+MailEditor* KeyhoteeMainWindow::createMailEditor()
+{
+  KH_TRACE_SCOPE( "KeyhoteeMainWindow::createMailEditor" );
+  auto msg_window = new MailEditor(this, _contact_completer, _addressbook_model);
+  connect( msg_window, &MailEditor::closed, [=](){ recycleMailEditor( msg_window ); } );
+  return msg_window;
+}
+
+void KeyhoteeMainWindow::recycleMailEditor( MailEditor* msg_window )
+{
+  if( _mail_editor_pool.size() >= MailEditorPoolSize )
+  {
+     msg_window->deleteLater();
+     return;
+  }
+  msg_window->reset();
+  _mail_editor_pool.push_back( msg_window );
+}
+
+void KeyhoteeMainWindow::warmMailEditorPool()
+{
+  if( _warming_mail_editors )
+     return;
+  _warming_mail_editors = true;
+
+  // one editor per pass so input and repaints get in between
+  QPointer<KeyhoteeMainWindow> self(this);
+  FcEventLoopBridge::async( [=](){
+     while( self && self->_mail_editor_pool.size() < MailEditorPoolSize )
+     {
+        fc::usleep( fc::milliseconds( MailEditorWarmDelayMs ) );
+        if( self && self->_mail_editor_pool.size() < MailEditorPoolSize )
+           self->_mail_editor_pool.push_back( self->createMailEditor() );
+     }
+     if( self )
+        self->_warming_mail_editors = false;
+  } );
 }
 
 ContactGui* KeyhoteeMainWindow::getContactGui( int contact_id )
@@ -461,32 +783,64 @@ ContactGui* KeyhoteeMainWindow::createContactGuiIfNecessary( int contact_id)
 
 void KeyhoteeMainWindow::createContactGui( int contact_id )
 {
-    //DLNFIX2 maybe cleanup/refactor ContactGui construction later
     auto new_contact_item = new QTreeWidgetItem(_contacts_root, 
                                                 (QTreeWidgetItem::ItemType)ContactItem );
     new_contact_item->setData( 0, ContactIdRole, contact_id );
 
-    auto view = new ContactView( ui->widget_stack );
+    //add new contactGui to map, its view is bound lazily when first shown
+    const Contact& contact = _addressbook_model->getContactById( contact_id );
+    ContactGui& contact_gui = _contact_guis[contact_id];
+    contact_gui = ContactGui(new_contact_item,contact);
+    contact_gui.updateTreeItemDisplay();
+}
 
-    //add new contactGui to map
-    ContactGui contact_gui(new_contact_item,view);
-    _contact_guis[contact_id] = contact_gui;
+ContactView* KeyhoteeMainWindow::bindContactView( ContactGui& contact_gui )
+{
+    if( contact_gui._view )
+    {
+        _contact_view_pool.remove( contact_gui._view );
+        _contact_view_pool.push_front( contact_gui._view );
+        return contact_gui._view;
+    }
 
-    view->setAddressBook( _addressbook_model );
-    const Contact& contact = _addressbook_model->getContactById( contact_id );
-    view->setContact(contact);
-    ui->widget_stack->addWidget( view );
+    ContactView* view = nullptr;
+    if( _contact_view_pool.size() < MaxContactViews )
+    {
+        view = new ContactView( ui->widget_stack );
+        view->setAddressBook( _addressbook_model );
+        ui->widget_stack->addWidget( view );
+    }
+    else
+    {
+        //recycle the least recently shown view, keeping its owner's draft
+        view = _contact_view_pool.back();
+        _contact_view_pool.pop_back();
+        for( auto itr = _contact_guis.begin(); itr != _contact_guis.end(); ++itr )
+        {
+            if( itr->second._view == view )
+            {
+                itr->second._chat_draft = view->chatDraft();
+                itr->second._view = nullptr;
+                break;
+            }
+        }
+    }
+    _contact_view_pool.push_front( view );
 
+    contact_gui._view = view;
+    view->setContact( _addressbook_model->getContactById( contact_gui._contact_id ) );
+    view->setChatDraft( contact_gui._chat_draft );
+    contact_gui._chat_draft = QString();
+    return view;
 }
 
 void KeyhoteeMainWindow::showContactGui( ContactGui& contact_gui )
 {
+    auto view = bindContactView( contact_gui );
     ui->side_bar->setCurrentItem( contact_gui._tree_item );
-    ui->widget_stack->setCurrentWidget( contact_gui._view );
+    ui->widget_stack->setCurrentWidget( view );
     if (contact_gui.isChatVisible())
     {
-    contact_gui._view->onChat();
+    view->onChat();
     }
 }
-
-
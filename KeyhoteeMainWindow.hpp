@@ -1,8 +1,14 @@
 #pragma once
 #include <QMainWindow>
+#include <functional>
 #include <memory>
+#include <list>
 #include <unordered_map>
+#include <vector>
 #include <bts/addressbook/addressbook.hpp>
+#include <bts/bitchat/bitchat_private_message.hpp>
+#include "AddressBook/ChatTranscript.hpp"
+#include "AddressBook/Contact.hpp"
 
 namespace Ui { class KeyhoteeMainWindow; }
 class QTreeWidgetItem;
@@ -12,11 +18,16 @@ class ApplicationDelegate;
 class QCompleter;
 class InboxView;
 class InboxModel;
+class MiningScheduler;
+class MailEditor;
+class PerfHud;
 class KeyhoteeMainWindow;
 
 /**
- *  GUI widgets and GUI state for a contact.
- *  Not all contacts have this, only contacts "active" in GUI.
+ *  GUI state for a contact.
+ *  Not all contacts have this, only contacts "active" in GUI.  The state is
+ *  kept lightweight, a ContactView from the window's pool is only bound while
+ *  the contact is (or recently was) on screen.
  */
 class ContactGui
 {
@@ -24,19 +35,27 @@ class ContactGui
 friend KeyhoteeMainWindow;
 
 private:
-    unsigned int     _unread_msg_count;
-    QTreeWidgetItem* _tree_item;
-    ContactView*     _view;
+    int               _contact_id;
+    std::string       _dac_id;
+    QString           _label;
+    unsigned int      _unread_msg_count;
+    QTreeWidgetItem*  _tree_item;
+    ContactView*      _view;
+    QString           _chat_draft;
+    ChatTranscriptPtr _transcript;
 
 public:
-         ContactGui() {}
-         ContactGui(QTreeWidgetItem* tree_item, ContactView* view)
-         : _tree_item(tree_item), _view(view), _unread_msg_count(0) {}
+         ContactGui()
+         : _contact_id(-1), _unread_msg_count(0), _tree_item(nullptr), _view(nullptr) {}
+         ContactGui(QTreeWidgetItem* tree_item, const Contact& contact)
+         : _contact_id(contact.wallet_index), _dac_id(contact.dac_id_string), _label(contact.getLabel()),
+           _unread_msg_count(0), _tree_item(tree_item), _view(nullptr) {}
 
     void updateTreeItemDisplay();
     void setUnreadMsgCount(unsigned int count);
     bool isChatVisible();
     void receiveChatMessage( const QString& from, const QString& msg, const QDateTime& dateTime);
+    void receiveChatMessages( const std::vector<ChatTranscript::Entry>& entries );
 private:
 };
 
@@ -67,17 +86,41 @@ class KeyhoteeMainWindow  : public QMainWindow
       bool         isSelectedContactGui(ContactGui* contactGui);
 
 
+      bool              contactsLoaded()const { return _contacts_loaded; }
+      AddressBookModel* addressBookModel()const { return _addressbook_model; }
+
+      /** hand a message to the application delegate as if it came from the network */
+      void         injectReceivedText( const bts::bitchat::decrypted_message& msg );
+      void         injectReceivedEmail( const bts::bitchat::decrypted_message& msg );
+      /** called with the contact id and message count whenever inbound chat reaches a ContactGui */
+      void         setChatDeliveredObserver( std::function<void(int,size_t)> observer );
+
       void         openDraft( int draft_id  );
       void         openMail( int message_id );
       void         openSent( int message_id );
 
-     
+  protected:
+      /** times paints of the window for the performance HUD */
+      virtual bool event( QEvent* event );
+
   private:
       friend class ApplicationDelegate;
       void addressBookDataChanged( const QModelIndex& top_left, const QModelIndex& bottom_right, const QVector<int>& roles );
 
-      void    createContactGui( int contact_id );
-      void    showContactGui( ContactGui& contact_gui );
+      void         loadModels();
+      void         startMining();
+      void         setupMiningBudgetMenu();
+      void         setupPerfHud();
+
+      MailEditor*  createMailEditor();
+      /** takes back a closed editor, reset for the next compose */
+      void         recycleMailEditor( MailEditor* msg_window );
+      /** tops the editor pool up while the window is idle */
+      void         warmMailEditorPool();
+
+      void         createContactGui( int contact_id );
+      void         showContactGui( ContactGui& contact_gui );
+      ContactView* bindContactView( ContactGui& contact_gui );
 
       QCompleter*                             _contact_completer;
       QTreeWidgetItem*                        _identities_root;
@@ -89,9 +132,20 @@ class KeyhoteeMainWindow  : public QMainWindow
       QTreeWidgetItem*                        _sent_root;
 
       InboxModel*                             _inbox;
+      MiningScheduler*                        _mining_scheduler;
+      PerfHud*                                _perf_hud;
       AddressBookModel*                       _addressbook_model;
       bts::addressbook::addressbook_ptr       _addressbook;
+      /// set once the address book model has been filled by loadModels()
+      bool                                    _contacts_loaded;
+      std::function<void(int,size_t)>         _chat_delivered_observer;
+      enum { MailEditorPoolSize = 2, MailEditorWarmDelayMs = 500 };
+      /// reset editors ready to be shown, compose takes one instead of building a MailEditor
+      std::vector<MailEditor*>                _mail_editor_pool;
+      bool                                    _warming_mail_editors;
       std::unordered_map<int,ContactGui>      _contact_guis;
+      /// recycled views, most recently shown first
+      std::list<ContactView*>                 _contact_view_pool;
       std::unique_ptr<Ui::KeyhoteeMainWindow> ui;
       std::unique_ptr<ApplicationDelegate>    _app_delegate;
 };
@@ -0,0 +1,292 @@
+#include "LoadGenerator.hpp"
+#include "KeyhoteeMainWindow.hpp"
+#include "AddressBook/AddressBookModel.hpp"
+#include "FcEventLoopBridge.hpp"
+
+#include <bts/application.hpp>
+#include <fc/crypto/sha256.hpp>
+#include <fc/exception/exception.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/thread/thread.hpp>
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+
+#include <algorithm>
+
+namespace
+{
+   const int    TickIntervalMs    = 5;
+   /// distinct messages prepared per fake contact, they are sent round robin
+   const int    MessagesPerContact = 8;
+
+   fc::thread& loadgenThread()
+   {
+      static fc::thread loadgen_thread( "loadgen" );
+      return loadgen_thread;
+   }
+
+   fc::ecc::private_key fakeContactKey( int index )
+   {
+      return fc::ecc::private_key::regenerate( fc::sha256::hash( "keyhotee loadgen contact " + std::to_string( index ) ) );
+   }
+
+   /** what the network thread would hand the delegate: signed by the sender, encrypted to us, decrypted */
+   template<typename MessageType>
+   bts::bitchat::decrypted_message receivedMessage( const MessageType& message,
+                                                    const fc::ecc::private_key& sender_key,
+                                                    const fc::ecc::private_key& receiver_key )
+   {
+      bts::bitchat::decrypted_message plain( message );
+      plain.sign( sender_key );
+      auto encrypted = plain.encrypt( receiver_key.get_public_key() );
+
+      bts::bitchat::decrypted_message received;
+      FC_ASSERT( encrypted.decrypt( receiver_key, received ), "unable to decrypt generated message" );
+      return received;
+   }
+
+   qint64 percentile( std::vector<qint64>& samples, double fraction )
+   {
+      if( samples.empty() )
+         return 0;
+      size_t index = std::min( samples.size() - 1, size_t( samples.size() * fraction ) );
+      std::nth_element( samples.begin(), samples.begin() + index, samples.end() );
+      return samples[index];
+   }
+}
+
+LoadGenerator::LoadGenerator( KeyhoteeMainWindow& window, const Options& options, QObject* parent )
+:QObject(parent),
+ _window(window),
+ _options(options),
+ _rate(options.start_rate),
+ _last_sustainable_rate(0),
+ _step_start_ns(0),
+ _step_injected(0),
+ _step_delivered(0),
+ _email_ns(0),
+ _emails(0),
+ _next_contact(0)
+{
+   _tick_timer.setInterval( TickIntervalMs );
+   connect( &_tick_timer, &QTimer::timeout, [=](){ tick(); } );
+}
+
+LoadGenerator::~LoadGenerator()
+{
+   _window.setChatDeliveredObserver( nullptr );
+}
+
+void LoadGenerator::start()
+{
+   QPointer<LoadGenerator> self(this);
+   FcEventLoopBridge::async( [=](){
+      while( self && !self->_window.contactsLoaded() )
+         fc::usleep( fc::milliseconds( 100 ) );
+      if( self )
+         self->prepareContacts();
+   } );
+}
+
+void LoadGenerator::prepareContacts()
+{
+   auto profile = bts::application::instance()->get_profile();
+   auto idents  = profile->identities();
+   if( idents.empty() )
+   {
+      elog( "loadgen needs an identity to receive messages" );
+      return;
+   }
+   auto my_key       = profile->get_keychain().get_identity_key( idents[0].dac_id );
+   auto address_book = profile->get_addressbook();
+   auto model        = _window.addressBookModel();
+
+   _contacts.resize( _options.contacts );
+   for( int i = 0; i < _options.contacts; ++i )
+   {
+      std::string dac_id   = "loadgen-" + std::to_string( i );
+      auto        existing = address_book->get_contact_by_dac_id( dac_id );
+      if( existing.valid() )
+      {
+         _contacts[i].contact_id = existing->wallet_index;
+      }
+      else
+      {
+         Contact contact;
+         contact.dac_id_string = dac_id;
+         contact.first_name    = "Load";
+         contact.last_name     = "Generator " + std::to_string( i );
+         contact.public_key    = fakeContactKey( i ).get_public_key();
+         _contacts[i].contact_id = model->storeContact( contact );
+      }
+      _contact_index[_contacts[i].contact_id] = i;
+   }
+
+   // signing and ECDH are the network thread's job, keep them off the GUI thread
+   ilog( "loadgen: preparing messages from ${n} contacts", ("n",_options.contacts) );
+   QPointer<LoadGenerator> self(this);
+   int contact_count = _options.contacts;
+   FcEventLoopBridge::async( [=](){
+      auto prepared = loadgenThread().async( [=](){
+         std::vector< std::vector<bts::bitchat::decrypted_message> > messages( contact_count );
+         for( int i = 0; i < contact_count; ++i )
+         {
+            auto sender_key = fakeContactKey( i );
+            for( int m = 0; m < MessagesPerContact; ++m )
+            {
+               bts::bitchat::private_text_message text( "load test message " + std::to_string( m ) +
+                                                        " from contact " + std::to_string( i ) );
+               messages[i].push_back( receivedMessage( text, sender_key, my_key ) );
+            }
+            bts::bitchat::private_email_message email;
+            email.subject = "load test mail from contact " + std::to_string( i );
+            email.body    = "<p>synthetic body</p>";
+            messages[i].push_back( receivedMessage( email, sender_key, my_key ) );
+         }
+         return messages;
+      } ).wait();
+
+      if( !self )
+         return;
+      for( int i = 0; i < contact_count; ++i )
+      {
+         self->_contacts[i].email = prepared[i].back();
+         self->_contacts[i].texts.assign( prepared[i].begin(), prepared[i].end() - 1 );
+      }
+      self->_window.setChatDeliveredObserver( [self]( int contact_id, size_t count ){
+                                                 if( self ) self->delivered( contact_id, count ); } );
+      self->_clock.start();
+      self->startStep();
+   } );
+}
+
+void LoadGenerator::startStep()
+{
+   _step_start_ns  = _clock.nsecsElapsed();
+   _step_injected  = 0;
+   _step_delivered = 0;
+   _email_ns       = 0;
+   _emails         = 0;
+   // messages still in flight from the last step count towards this one
+   _step_latencies_ns.clear();
+   ilog( "loadgen: ${r} messages/s", ("r",_rate) );
+   _tick_timer.start();
+}
+
+void LoadGenerator::tick()
+{
+   qint64 now     = _clock.nsecsElapsed();
+   qint64 elapsed = now - _step_start_ns;
+   if( elapsed >= qint64( _options.step_seconds ) * 1000000000ll )
+   {
+      finishStep();
+      return;
+   }
+
+   // catch up to the target rate, however late this tick is
+   qint64 due = qint64( double( _rate ) * elapsed / 1e9 ) - _step_injected;
+   for( qint64 i = 0; i < due; ++i )
+   {
+      auto& contact = _contacts[_next_contact];
+      _next_contact = (_next_contact + 1) % _contacts.size();
+
+      if( _step_injected % 10 == 9 )
+      {
+         // every tenth message is a mail, the delegate handles those synchronously
+         qint64 start = _clock.nsecsElapsed();
+         _window.injectReceivedEmail( contact.email );
+         _email_ns += _clock.nsecsElapsed() - start;
+         ++_emails;
+      }
+      else
+      {
+         contact.pending.push_back( _clock.nsecsElapsed() );
+         _window.injectReceivedText( contact.texts[_step_injected % contact.texts.size()] );
+      }
+      ++_step_injected;
+   }
+}
+
+void LoadGenerator::delivered( int contact_id, size_t count )
+{
+   auto itr = _contact_index.find( contact_id );
+   if( itr == _contact_index.end() )
+      return;
+   auto&  contact = _contacts[itr->second];
+   qint64 now     = _clock.nsecsElapsed();
+   for( size_t i = 0; i < count && !contact.pending.empty(); ++i )
+   {
+      _step_latencies_ns.push_back( now - contact.pending.front() );
+      contact.pending.pop_front();
+      ++_step_delivered;
+   }
+}
+
+void LoadGenerator::finishStep()
+{
+   _tick_timer.stop();
+
+   qint64 elapsed_ns  = _clock.nsecsElapsed() - _step_start_ns;
+   qint64 texts       = _step_injected - _emails;
+   qint64 backlog     = texts - _step_delivered;
+   qint64 p50_ns      = percentile( _step_latencies_ns, 0.50 );
+   qint64 p99_ns      = percentile( _step_latencies_ns, 0.99 );
+   qint64 max_ns      = _step_latencies_ns.empty() ? 0 : *std::max_element( _step_latencies_ns.begin(), _step_latencies_ns.end() );
+   double actual_rate = _step_injected * 1e9 / elapsed_ns;
+   bool   sustainable = p99_ns <= qint64( _options.max_p99_ms ) * 1000000ll &&
+                        backlog <= std::max<qint64>( 1, _rate / 10 ) &&
+                        actual_rate >= _rate * 0.9;
+
+   QJsonObject step;
+   step["target_rate"]      = _rate;
+   step["actual_rate"]      = actual_rate;
+   step["texts"]            = double( texts );
+   step["emails"]           = double( _emails );
+   step["delivered"]        = double( _step_delivered );
+   step["backlog"]          = double( backlog );
+   step["latency_p50_ms"]   = p50_ns / 1e6;
+   step["latency_p99_ms"]   = p99_ns / 1e6;
+   step["latency_max_ms"]   = max_ns / 1e6;
+   step["email_call_avg_ms"] = _emails ? _email_ns / 1e6 / _emails : 0.0;
+   step["sustainable"]      = sustainable;
+   _steps.append( step );
+   ilog( "loadgen: target ${t}/s actual ${a}/s p50 ${p50} ms p99 ${p99} ms backlog ${b}",
+         ("t",_rate)("a",actual_rate)("p50",p50_ns / 1e6)("p99",p99_ns / 1e6)("b",backlog) );
+
+   if( sustainable )
+      _last_sustainable_rate = _rate;
+   if( sustainable && _rate < _options.max_rate )
+   {
+      _rate = std::min( _rate * 2, _options.max_rate );
+      startStep();
+      return;
+   }
+   writeReport();
+}
+
+void LoadGenerator::writeReport()
+{
+   _window.setChatDeliveredObserver( nullptr );
+
+   QJsonObject report;
+   report["contacts"]               = _options.contacts;
+   report["max_p99_ms"]             = _options.max_p99_ms;
+   report["step_seconds"]           = _options.step_seconds;
+   report["max_sustainable_rate"]   = _last_sustainable_rate;
+   report["steps"]                  = _steps;
+   ilog( "loadgen: max sustainable rate ${r} messages/s", ("r",_last_sustainable_rate) );
+
+   if( _options.report_file.isEmpty() )
+      return;
+   QFile file( _options.report_file );
+   if( !file.open( QIODevice::WriteOnly ) )
+   {
+      elog( "unable to write loadgen report ${f}", ("f",_options.report_file.toStdString()) );
+      return;
+   }
+   file.write( QJsonDocument( report ).toJson() );
+   ilog( "loadgen: report written to ${f}", ("f",_options.report_file.toStdString()) );
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <bts/bitchat/bitchat_private_message.hpp>
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QObject>
+#include <QTimer>
+
+#include <deque>
+#include <map>
+#include <vector>
+
+class KeyhoteeMainWindow;
+
+/**
+ *  Offline load test for the inbound message path (--loadgen).
+ *
+ *  Creates M fake contacts with deterministic keys in the current profile's
+ *  address book, prepares messages from each of them the way the network
+ *  would (signed by the contact, encrypted to our first identity and
+ *  decrypted again) and feeds them to the application delegate at a rate
+ *  that doubles every step.
+ *
+ *  Latency is measured from the delegate call to the moment the batch reaches
+ *  the contact's view or transcript.  A step is sustainable while the p99
+ *  latency stays under the limit and the backlog stays small; the run stops at
+ *  the first step that isn't and writes a JSON report.
+ *
+ *  The fake contacts are stored in the address book, so main() only starts
+ *  it for a profile whose name starts with "scratch".
+ */
+class LoadGenerator : public QObject
+{
+  public:
+     struct Options
+     {
+        Options():contacts(20),start_rate(50),max_rate(50000),step_seconds(5),max_p99_ms(100){}
+
+        int     contacts;
+        /// messages per second of the first step
+        int     start_rate;
+        int     max_rate;
+        int     step_seconds;
+        int     max_p99_ms;
+        QString report_file;
+     };
+
+     LoadGenerator( KeyhoteeMainWindow& window, const Options& options, QObject* parent = nullptr );
+     ~LoadGenerator();
+
+     /** waits for the address book to load, prepares the messages then runs */
+     void start();
+
+  private:
+     struct FakeContact
+     {
+        int                                          contact_id;
+        std::vector<bts::bitchat::decrypted_message> texts;
+        bts::bitchat::decrypted_message              email;
+        /// injection times of messages not yet delivered, in order
+        std::deque<qint64>                           pending;
+     };
+
+     void prepareContacts();
+     void startStep();
+     void tick();
+     void finishStep();
+     void delivered( int contact_id, size_t count );
+     void writeReport();
+
+     KeyhoteeMainWindow&          _window;
+     Options                      _options;
+     std::vector<FakeContact>     _contacts;
+     std::map<int, size_t>        _contact_index;
+
+     QTimer                       _tick_timer;
+     QElapsedTimer                _clock;
+     int                          _rate;
+     int                          _last_sustainable_rate;
+     qint64                       _step_start_ns;
+     qint64                       _step_injected;
+     qint64                       _step_delivered;
+     qint64                       _email_ns;
+     qint64                       _emails;
+     size_t                       _next_contact;
+     std::vector<qint64>          _step_latencies_ns;
+     QJsonArray                   _steps;
+};
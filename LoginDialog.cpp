@@ -1,50 +1,138 @@
 #include "LoginDialog.hpp"
 #include <ui_LoginDialog.h>
+#include "FcEventLoopBridge.hpp"
+#include "Trace.hpp"
 #include <bts/application.hpp>
 
 #include <fc/log/logger.hpp>
 #include <fc/thread/thread.hpp>
 
+#include <QPointer>
+#include <QPropertyAnimation>
+
+namespace
+{
+   /** key derivation and opening the databases happen here, never on the GUI thread */
+   fc::thread& unlockThread()
+   {
+      static fc::thread unlock_thread( "unlock" );
+      return unlock_thread;
+   }
+}
+
 LoginDialog::LoginDialog( QWidget* parent )
-:QDialog(parent)
+:QDialog(parent),
+ _unlock_attempt(0),
+ _load_in_flight(false),
+ _cancelled_unlock_loaded(false)
 {
     ui.reset( new Ui::LoginDialog() );
     ui->setupUi(this);
     ui->password->setFocus();
     connect( ui->login, &QPushButton::clicked, this, &LoginDialog::onLogin );
     connect( ui->quit, &QPushButton::clicked, this, &LoginDialog::onQuit );
+    connect( ui->cancel, &QPushButton::clicked, this, &LoginDialog::onCancel );
+    setUnlocking(false);
 }
 
 LoginDialog::~LoginDialog()
 {}
 
+void LoginDialog::setUnlocking( bool unlocking )
+{
+    ui->unlock_progress->setVisible(unlocking);
+    ui->cancel->setVisible(unlocking);
+    ui->login->setEnabled(!unlocking && !_load_in_flight);
+    ui->password->setEnabled(!unlocking);
+}
 
 void LoginDialog::onLogin()
 {
-    try {
-       password = ui->password->text().toStdString();
-       auto profile = bts::application::instance()->load_profile(password);
-       if( profile )
+    if( _load_in_flight )
+        return;
+    password = ui->password->text().toStdString();
+    if( _cancelled_unlock_loaded && password == _cancelled_unlock_password )
+    {
+        accept();
+        return;
+    }
+    _load_in_flight = true;
+    setUnlocking(true);
+
+    int                  attempt = ++_unlock_attempt;
+    QPointer<LoginDialog> self(this);
+    std::string          unlock_password = password;
+    FcEventLoopBridge::async( [=](){
+       bool success = false;
+       try {
+          auto app     = bts::application::instance();
+          auto profile = unlockThread().async( [=](){
+                            KH_TRACE_SCOPE( "load_profile" );
+                            return app->load_profile(unlock_password); } ).wait();
+          success = !!profile;
+       }
+       catch ( const fc::exception& e )
        {
-           accept();
+          wlog( "error ${w}", ("w",e.to_detail_string()) );
        }
-    } 
-    catch ( const fc::exception& e )
+       if( !self )
+          return;
+       self->_load_in_flight = false;
+       if( self->_unlock_attempt == attempt )
+          self->unlockFinished(success);
+       else
+          self->cancelledUnlockFinished(success, unlock_password);
+    } );
+}
+
+void LoginDialog::login( const QString& password )
+{
+    ui->password->setText(password);
+    onLogin();
+}
+
+void LoginDialog::onCancel()
+{
+    // load_profile cannot be interrupted, the password can be edited meanwhile but
+    // logging in again waits for it to return
+    ++_unlock_attempt;
+    setUnlocking(false);
+    ui->password->setFocus();
+}
+
+void LoginDialog::cancelledUnlockFinished( bool success, const std::string& unlock_password )
+{
+    // the profile is open now, remember which password did it rather than loading it twice
+    _cancelled_unlock_loaded   = success;
+    _cancelled_unlock_password = success ? unlock_password : std::string();
+    setUnlocking(false);
+}
+
+void LoginDialog::unlockFinished( bool success )
+{
+    setUnlocking(false);
+    if( success )
     {
-        wlog( "error ${w}", ("w",e.to_detail_string()) );
+        accept();
+        return;
     }
     ui->password->setText(QString());
+    ui->password->setFocus();
     shake();
 }
+
 void LoginDialog::shake( )
 {
-    move( pos() + QPoint(10,0) );
-    fc::usleep( fc::microseconds( 50*1000 ) );
-    move( pos() + QPoint(-20,0) );
-    fc::usleep( fc::microseconds( 50*1000 ) );
-    move( pos() + QPoint(20,0) );
-    fc::usleep( fc::microseconds( 50*1000 ) );
-    move( pos() + QPoint(-10,0) );
+    QPoint origin = pos();
+    auto animation = new QPropertyAnimation( this, "pos", this );
+    animation->setDuration( 200 );
+    animation->setStartValue( origin );
+    animation->setKeyValueAt( 0.125, origin + QPoint(10,0) );
+    animation->setKeyValueAt( 0.375, origin + QPoint(-10,0) );
+    animation->setKeyValueAt( 0.625, origin + QPoint(10,0) );
+    animation->setKeyValueAt( 0.875, origin + QPoint(-10,0) );
+    animation->setEndValue( origin );
+    animation->start( QAbstractAnimation::DeleteWhenStopped );
 }
 void LoginDialog::onQuit()
 {
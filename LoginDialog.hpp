@@ -11,10 +11,24 @@ class LoginDialog : public QDialog
       ~LoginDialog();
 
       void onLogin();
+      /** unlocks with the given password as if it had been typed in */
+      void login( const QString& password );
+      void onCancel();
       void onQuit();
       void shake();
       
       std::string password;
    private:
+      void setUnlocking( bool unlocking );
+      void unlockFinished( bool success );
+      void cancelledUnlockFinished( bool success, const std::string& unlock_password );
+
       std::unique_ptr<Ui::LoginDialog> ui;
+      /// bumped on every attempt so results of a cancelled unlock are ignored
+      int                              _unlock_attempt;
+      /// load_profile can't be interrupted, no other attempt starts until it returns
+      bool                             _load_in_flight;
+      /// a cancelled attempt that went on to load the profile, logging in again with it doesn't reload
+      bool                             _cancelled_unlock_loaded;
+      std::string                      _cancelled_unlock_password;
 };
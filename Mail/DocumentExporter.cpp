@@ -0,0 +1,201 @@
+#include "DocumentExporter.hpp"
+#include "../MetricsRegistry.hpp"
+#include "../Trace.hpp"
+
+#include <QAbstractTextDocumentLayout>
+#include <QApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QPainter>
+#include <QSaveFile>
+#include <QTextDocument>
+#include <QTextDocumentWriter>
+#include <QTextFrame>
+#include <QThread>
+#ifndef QT_NO_PRINTER
+#include <QPrinter>
+#endif
+
+namespace
+{
+   class ExportThread : public QThread
+   {
+      public:
+         ExportThread( std::function<void()> body ):_body(body){}
+
+      protected:
+         virtual void run() { _body(); }
+
+      private:
+         std::function<void()> _body;
+   };
+
+   QByteArray writerFormat( const QString& file_name )
+   {
+      QString suffix = QFileInfo( file_name ).suffix().toLower();
+      if( suffix == "odt" )
+         return "odf";
+      if( suffix == "txt" )
+         return "plaintext";
+      return "html";
+   }
+}
+
+DocumentExporter::DocumentExporter( const QTextDocument& document, const QString& file_name, Format format )
+:QObject(qApp),
+ _file_name(file_name),
+ _format(format),
+ _cancelled(false)
+{
+   // copying the fragments is cheap, laying them out and writing them isn't
+   _document.reset( document.clone() );
+   _thread.reset( new ExportThread( [=](){ run(); } ) );
+   _document->moveToThread( _thread.get() );
+   connect( this, &DocumentExporter::finished, this, &QObject::deleteLater );
+}
+
+DocumentExporter::~DocumentExporter()
+{
+   cancel();
+   _thread->wait();
+}
+
+void DocumentExporter::start()
+{
+   _thread->start( QThread::LowPriority );
+}
+
+void DocumentExporter::cancel()
+{
+   _cancelled = true;
+}
+
+void DocumentExporter::run()
+{
+   KH_TRACE_SCOPE( "DocumentExporter::run" );
+   static Metric& running = MetricsRegistry::instance().gauge( "exports.running" );
+   running.add();
+   QString error;
+   bool    success = _format == Pdf ? writePdf( error ) : writeNative( error );
+   if( _cancelled )
+   {
+      success = false;
+      error   = tr("Cancelled");
+   }
+   _document->moveToThread( qApp->thread() );
+   running.add( -1 );
+   Q_EMIT finished( success, error );
+}
+
+bool DocumentExporter::writeNative( QString& error )
+{
+   // QTextDocumentWriter is a single call, the only progress to report is done or not
+   Q_EMIT progress( 0, 1 );
+   QSaveFile file( _file_name );
+   if( !file.open( QIODevice::WriteOnly ) )
+   {
+      error = file.errorString();
+      return false;
+   }
+   QTextDocumentWriter writer( &file, writerFormat( _file_name ) );
+   if( !writer.write( _document.get() ) )
+   {
+      error = tr("Unable to write %1").arg( _file_name );
+      file.cancelWriting();
+      return false;
+   }
+   if( _cancelled )
+   {
+      file.cancelWriting();
+      return false;
+   }
+   if( !file.commit() )
+   {
+      error = file.errorString();
+      return false;
+   }
+   Q_EMIT progress( 1, 1 );
+   return true;
+}
+
+bool DocumentExporter::writePdf( QString& error )
+{
+#ifdef QT_NO_PRINTER
+   error = tr("PDF export is not available");
+   return false;
+#else
+   // QPrinter writes as it goes, build the PDF next to the target and move it in place at the end
+   QString part_file = _file_name + ".part";
+   bool    printed   = false;
+   {
+      QPrinter printer( QPrinter::HighResolution );
+      printer.setOutputFormat( QPrinter::PdfFormat );
+      printer.setOutputFileName( part_file );
+      printed = printPages( *_document, printer, [=]( int done, int total ){
+                   Q_EMIT progress( done, total );
+                   return !_cancelled; } );
+   }
+   if( !printed )
+   {
+      QFile::remove( part_file );
+      if( !_cancelled )
+         error = tr("Unable to write %1").arg( part_file );
+      return false;
+   }
+   QFile::remove( _file_name );
+   if( !QFile::rename( part_file, _file_name ) )
+   {
+      error = tr("Unable to move %1 to %2").arg( part_file ).arg( _file_name );
+      return false;
+   }
+   return true;
+#endif
+}
+
+bool DocumentExporter::printPages( QTextDocument& document, QPrinter& printer,
+                                   const std::function<bool(int,int)>& page_done )
+{
+#ifdef QT_NO_PRINTER
+   return false;
+#else
+   QPainter painter( &printer );
+   if( !painter.isActive() )
+      return false;
+
+   // same 2cm margins QTextDocument::print() uses
+   auto layout = document.documentLayout();
+   layout->setPaintDevice( &printer );
+   int  margin = int( (2 / 2.54) * printer.logicalDpiY() );
+   QTextFrameFormat frame_format = document.rootFrame()->frameFormat();
+   frame_format.setMargin( margin );
+   document.rootFrame()->setFrameFormat( frame_format );
+
+   QRectF page_rect( printer.pageRect() );
+   QSizeF page_size( page_rect.width(), page_rect.height() );
+   document.setPageSize( page_size );
+   int page_count = document.pageCount();
+
+   for( int page = 0; page < page_count; ++page )
+   {
+      if( page > 0 )
+         printer.newPage();
+
+      QRectF view( 0, page * page_size.height(), page_size.width(), page_size.height() );
+      painter.save();
+      painter.translate( 0, -view.top() );
+      painter.setClipRect( view );
+      QAbstractTextDocumentLayout::PaintContext context;
+      context.clip = view;
+      context.palette.setColor( QPalette::Text, Qt::black );
+      layout->draw( &painter, context );
+      painter.restore();
+
+      if( !page_done( page + 1, page_count ) )
+      {
+         printer.abort();
+         return false;
+      }
+   }
+   return true;
+#endif
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <QObject>
+#include <QString>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+class QPrinter;
+class QTextDocument;
+class QThread;
+
+/**
+ *  Saves a document or exports it to PDF on a worker thread.
+ *
+ *  The exporter works on a clone taken when it is constructed, the original
+ *  can be edited (or destroyed) while it runs.  Output goes to a temporary
+ *  file that only replaces the target once everything was written, a
+ *  cancelled export leaves the target untouched.
+ *
+ *  Parented to the application so a running export outlives the editor that
+ *  started it, it deletes itself once finished.
+ */
+class DocumentExporter : public QObject
+{
+   Q_OBJECT
+   public:
+      enum Format
+      {
+         /// by file suffix: odt, html or plain text, as QTextDocumentWriter does
+         Native,
+         Pdf
+      };
+
+      DocumentExporter( const QTextDocument& document, const QString& file_name, Format format );
+      /** cancels a running export and waits for the worker */
+      ~DocumentExporter();
+
+      void start();
+      /** safe from any thread, takes effect at the next page */
+      void cancel();
+
+      /**
+       *  Lays out document for printer and paints it page by page, like
+       *  QTextDocument::print() but reporting each page.
+       *  @param page_done called with pages done and page count, return false to stop
+       *  @return false if the printer couldn't be opened or page_done stopped it
+       */
+      static bool printPages( QTextDocument& document, QPrinter& printer,
+                              const std::function<bool(int,int)>& page_done );
+
+   Q_SIGNALS:
+      void progress( int done, int total );
+      void finished( bool success, const QString& error );
+
+   private:
+      void run();
+      bool writeNative( QString& error );
+      bool writePdf( QString& error );
+
+      std::unique_ptr<QTextDocument> _document;
+      QString                        _file_name;
+      Format                         _format;
+      std::atomic<bool>              _cancelled;
+      std::unique_ptr<QThread>       _thread;
+};
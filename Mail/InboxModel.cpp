@@ -1,4 +1,6 @@
 #include "InboxModel.hpp"
+#include "IconProvider.hpp"
+#include "Trace.hpp"
 #include <QIcon>
 #include <QPixmap>
 #include <QImage>
@@ -28,39 +30,61 @@ QDateTime toQDateTime( const fc::time_point_sec& sec )
    return QDateTime();
 }
 
-InboxModel::InboxModel( QObject* parent, const bts::profile_ptr& user_profile )
+InboxModel::InboxModel( QObject* parent, const bts::profile_ptr& user_profile, bool load_headers )
 : QAbstractTableModel(parent),
   my( new Detail::InboxModelImpl() )
 {
    my->_user_profile = user_profile;
-   my->_attachment_icon = QIcon( ":/images/paperclip-icon.png" );
-   my->_chat_icon = QIcon( ":/images/chat.png" );
-   my->_money_icon = QIcon( ":/images/bitcoin.png" );
-   my->_read_icon = QIcon( ":/images/read-icon.png" );
+   my->_attachment_icon = IconProvider::icon( ":/images/paperclip-icon.png" );
+   my->_chat_icon = IconProvider::icon( ":/images/chat.png" );
+   my->_money_icon = IconProvider::icon( ":/images/bitcoin.png" );
+   my->_read_icon = IconProvider::icon( ":/images/read-icon.png" );
 
-   std::vector<bts::bitchat::message_header>  headers = user_profile->get_inbox()->fetch_headers( 
-                                                                                     bts::bitchat::private_email_message::type );
-   my->_headers.resize(headers.size());
+   if( load_headers )
+   {
+      setHeaders( fetchHeaders( user_profile ) );
+   }
+}
+
+std::vector<bts::bitchat::message_header> InboxModel::fetchHeaders( const bts::profile_ptr& user_profile )
+{
+   return user_profile->get_inbox()->fetch_headers( bts::bitchat::private_email_message::type );
+}
 
-   auto abook = user_profile->get_addressbook();
+void InboxModel::setHeaders( const std::vector<bts::bitchat::message_header>& headers )
+{
+   KH_TRACE_SCOPE( "InboxModel::setHeaders" );
+   std::vector<MessageHeader> message_headers( headers.size() );
+
+   // contacts are resolved here rather than in fetchHeaders(), the address book
+   // is only ever touched from the GUI thread
+   auto abook = my->_user_profile->get_addressbook();
    for( uint32_t i = 0; i < headers.size(); ++i )
    {
-      my->_headers[i].digest          = headers[i].digest;
-      my->_headers[i].date_received   = toQDateTime( headers[i].received_time );
-      auto to_contact                 = abook->get_contact_by_public_key( headers[i].to_key );
-      auto from_contact               = abook->get_contact_by_public_key( headers[i].from_key );
+      message_headers[i].digest          = headers[i].digest;
+      message_headers[i].date_received   = toQDateTime( headers[i].received_time );
+      auto to_contact                    = abook->get_contact_by_public_key( headers[i].to_key );
+      auto from_contact                  = abook->get_contact_by_public_key( headers[i].from_key );
       if( to_contact )
       {
-          my->_headers[i].to   =  to_contact->dac_id_string.c_str();
+          message_headers[i].to   =  to_contact->dac_id_string.c_str();
       }
 
       if( from_contact )
       {
-          my->_headers[i].from =  from_contact->dac_id_string.c_str();
+          message_headers[i].from =  from_contact->dac_id_string.c_str();
       }
-//      my->_headers[i].date_sent     = toQDateTime( headers[i].
-      my->_headers[i].read_mark       = headers[i].read_mark;
+//      message_headers[i].date_sent     = toQDateTime( headers[i].
+      message_headers[i].read_mark       = headers[i].read_mark;
    }
+   setMessageHeaders( std::move( message_headers ) );
+}
+
+void InboxModel::setMessageHeaders( std::vector<MessageHeader> headers )
+{
+   beginResetModel();
+   my->_headers.swap( headers );
+   endResetModel();
 }
 
 InboxModel::~InboxModel()
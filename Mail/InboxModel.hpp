@@ -1,6 +1,7 @@
 #pragma once
 #include <QtGui>
 #include <bts/profile.hpp>
+#include <bts/bitchat/bitchat_message_db.hpp>
 
 namespace Detail { class InboxModelImpl; }
 
@@ -26,9 +27,18 @@ class MessageHeader
 class InboxModel : public QAbstractTableModel
 {
   public:
-    InboxModel( QObject* parent, const bts::profile_ptr& user_profile );
+    /**
+     *  @param load_headers when false the model starts empty, fetch the headers
+     *         with fetchHeaders() (safe on any thread) and pass them to setHeaders()
+     */
+    InboxModel( QObject* parent, const bts::profile_ptr& user_profile, bool load_headers = true );
     ~InboxModel();
 
+    static std::vector<bts::bitchat::message_header> fetchHeaders( const bts::profile_ptr& user_profile );
+    void setHeaders( const std::vector<bts::bitchat::message_header>& headers );
+    /** replaces the contents with headers whose contacts are already resolved */
+    void setMessageHeaders( std::vector<MessageHeader> headers );
+
     enum Columns
     {
         Read,
@@ -3,7 +3,7 @@
 #include <QClipboard>
 #include <QColorDialog>
 #include <QComboBox>
-#include <QFontComboBox>
+#include <QStringListModel>
 #include <QFile>
 #include <QFileDialog>
 #include <QFileInfo>
@@ -21,12 +21,16 @@
 #include <QCloseEvent>
 #include <QMessageBox>
 #include <QMimeData>
+#include <QProgressDialog>
 #ifndef QT_NO_PRINTER
 #include <QPrintDialog>
 #include <QPrinter>
 #include <QPrintPreviewDialog>
 #endif
 #include "../ContactListEdit.hpp"
+#include "../EventJournal.hpp"
+#include "../IconProvider.hpp"
+#include "../Trace.hpp"
 
 #include "MailEditor.hpp"
 #include <fc/log/logger.hpp>
@@ -34,6 +38,8 @@
 #include <bts/application.hpp>
 #include <bts/profile.hpp>
 
+#include <set>
+
 #ifdef Q_OS_MAC
 const QString rsrcPath = ":/images/mac";
 #else
@@ -43,13 +49,41 @@ const QString rsrcPath = ":/images/win";
 using namespace bts::bitchat;
 using namespace bts::addressbook;
 
-MailEditor::MailEditor(QWidget *parent, QCompleter* contact_completer)
+namespace
+{
+   /**
+    *  Font families and sizes are the same for every editor, enumerate the
+    *  font database once and let all the combos share the models.
+    */
+   QStringListModel* sharedFontFamilies()
+   {
+      static QStringListModel* font_families = new QStringListModel( QFontDatabase().families(), qApp );
+      return font_families;
+   }
+
+   QStringListModel* sharedFontSizes()
+   {
+      static QStringListModel* font_sizes = nullptr;
+      if( !font_sizes )
+      {
+         QStringList sizes;
+         foreach(int size, QFontDatabase::standardSizes())
+            sizes << QString::number(size);
+         font_sizes = new QStringListModel( sizes, qApp );
+      }
+      return font_sizes;
+   }
+}
+
+MailEditor::MailEditor(QWidget *parent, QCompleter* contact_completer, AddressBookModel* address_book)
 : QDialog(parent),
-  _contact_completer(contact_completer)
+  _contact_completer(contact_completer),
+  _address_book(address_book),
+  _close_after_save(false)
 {
-    to_values = new QTextDocument(this);
-    cc_values = new QTextDocument(this);
-    bcc_values = new QTextDocument(this);
+    to_values = new RecipientDocument(this);
+    cc_values = new RecipientDocument(this);
+    bcc_values = new RecipientDocument(this);
 
 //    setToolButtonStyle(Qt::ToolButtonFollowStyle);
     layout = new QGridLayout(this);
@@ -138,14 +172,57 @@ void MailEditor::addToContact(int contact_id)
     auto app = bts::application::instance();
     auto profile = app->get_profile();
     auto contacts = profile->get_addressbook()->get_contacts();
-    QString to_string = contacts[contact_id].getFullName().c_str();
-    to_field->insertCompletion(to_string);
+    const auto& contact = contacts[contact_id];
+    RecipientDocument::Recipient recipient;
+    recipient.label      = contact.getFullName().c_str();
+    recipient.contact_id = contact_id;
+    recipient.dac_id     = contact.dac_id_string;
+    recipient.public_key = contact.public_key;
+    to_field->addRecipient(recipient);
+}
+
+void MailEditor::reset()
+{
+    to_values->clear();
+    cc_values->clear();
+    bcc_values->clear();
+    actionToggleCc->setChecked(false);
+    actionToggleBcc->setChecked(false);
+    actionToggleFrom->setChecked(false);
+    actionFormat->setChecked(false);
+    actionAttachMoney->setChecked(false);
+    money_amount->clear();
+    money_unit->setCurrentIndex(0);
+
+    // toggling the fields rebuilt the address bar, the subject is kept through that
+    subject_field->clear();
+    setWindowTitle( tr( "New Message" ) );
+
+    textEdit->clear();
+    textEdit->setCurrentCharFormat(QTextCharFormat());
+    textEdit->document()->clearUndoRedoStacks();
+    textEdit->document()->setModified(false);
+    fontChanged(textEdit->font());
+    colorChanged(textEdit->textColor());
+    alignmentChanged(textEdit->alignment());
+    _fileName.clear();
+    _close_after_save = false;
+}
+
+void MailEditor::done(int result)
+{
+    // QDialog::done() would hide the editor without asking to save or emitting closed()
+    setResult(result);
+    close();
 }
 
 void MailEditor::closeEvent(QCloseEvent* closeEvent)
 {
     if (maybeSave())
+    {
         closeEvent->accept();
+        Q_EMIT closed();
+    }
     else
         closeEvent->ignore();
 }
@@ -174,7 +251,7 @@ void MailEditor::setupMailActions()
 
     QAction* action;
 
-//    QIcon newIcon = QIcon::fromTheme("mail-send", QIcon(rsrcPath + "/filenew.png"));
+//    QIcon newIcon = IconProvider::themeIcon("mail-send", rsrcPath + "/filenew.png");
  //   a = new QAction( newIcon, tr("&Send"), this);
   //  a->setPriority(QAction::LowPriority);
    // a->setShortcut(QKeySequence::Save);
@@ -182,7 +259,7 @@ void MailEditor::setupMailActions()
     //tool_bar->addAction(a);
     //menu->addAction(a);
 
-//    a = new QAction(QIcon::fromTheme("document-open", QIcon(rsrcPath + "/fileopen.png")),
+//    a = new QAction(IconProvider::themeIcon("document-open", rsrcPath + "/fileopen.png"),
  //                   tr("&Open..."), this);
 //    a->setShortcut(QKeySequence::Open);
 //    connect(a, SIGNAL(triggered()), this, SLOT(fileOpen()));
@@ -191,7 +268,7 @@ void MailEditor::setupMailActions()
 
     //menu->addSeparator();
 
-    actionSave = action = new QAction(QIcon::fromTheme("mail-send", QIcon(":/images/128x128/send_mail.png")),
+    actionSave = action = new QAction(IconProvider::themeIcon("mail-send", ":/images/128x128/send_mail.png"),
                                  tr("&Send"), this);
     action->setShortcut(QKeySequence::Save);
     connect(action, SIGNAL(triggered()), this, SLOT(sendMailMessage()));
@@ -211,12 +288,12 @@ void MailEditor::setupMailActions()
     actionToggleFrom->setCheckable(true);
 
     fieldsButton = new QToolButton();
-    fieldsButton->setIcon(QIcon( ":/images/gear.png" ) );
+    fieldsButton->setIcon(IconProvider::icon( ":/images/gear.png" ) );
     fieldsButton->setMenu( fieldsMenu );
     fieldsButton->setPopupMode( QToolButton::InstantPopup );
     tool_bar->addWidget( fieldsButton );
 
-    action = new QAction(QIcon::fromTheme("mail-format", QIcon(":/images/format_text.png")),
+    actionFormat = action = new QAction(IconProvider::themeIcon("mail-format", ":/images/format_text.png"),
                                  tr("&Format"), this);
  //   a->setShortcut(QKeySequence::Save);
     connect(action, &QAction::toggled, this, &MailEditor::enableFormat);
@@ -225,7 +302,7 @@ void MailEditor::setupMailActions()
     tool_bar->addAction(action);
 
 
-    actionAttachMoney = action = new QAction(QIcon::fromTheme("mail-money", QIcon(":/images/money-in-envelope.png")),
+    actionAttachMoney = action = new QAction(IconProvider::themeIcon("mail-money", ":/images/money-in-envelope.png"),
                                  tr("&Attach Money"), this);
  //   a->setShortcut(QKeySequence::Save);
     connect(action, &QAction::toggled, this, &MailEditor::enableSendMoney );
@@ -233,7 +310,7 @@ void MailEditor::setupMailActions()
     action->setEnabled(true);
     tool_bar->addAction(action);
 
-    actionAttachFile = action = new QAction(QIcon::fromTheme("mail-file", QIcon(":/images/paperclip-icon.png")),
+    actionAttachFile = action = new QAction(IconProvider::themeIcon("mail-file", ":/images/paperclip-icon.png"),
                                  tr("&Attach File"), this);
  //   a->setShortcut(QKeySequence::Save);
     connect(action, &QAction::toggled, this, &MailEditor::showAttachFileDialog );
@@ -269,7 +346,6 @@ void MailEditor::setupAddressBar()
    for( uint32_t i = 0; i < idents.size(); ++i )
    {
       // TODO: add user icon?
-      elog( "From field... " );
       from_field->insertItem( i, idents[i].dac_id.c_str() );
    }
    subject_field = new QLineEdit(address_bar);
@@ -297,6 +373,7 @@ void MailEditor::updateAddressBarLayout()
 
    to_field = new ContactListEdit(address_bar);
    to_field->setCompleter(_contact_completer);
+   to_field->setAddressBook(_address_book);
    to_field->setDocument(to_values);
    address_layout->addRow( "To:",  to_field );
 
@@ -304,6 +381,7 @@ void MailEditor::updateAddressBarLayout()
    {
       cc_field = new ContactListEdit(address_bar);
       cc_field->setCompleter(_contact_completer);
+      cc_field->setAddressBook(_address_book);
       cc_field->setDocument(cc_values);
       address_layout->addRow( "Cc:",  cc_field );
    }
@@ -312,6 +390,7 @@ void MailEditor::updateAddressBarLayout()
    {
       bcc_field = new ContactListEdit(address_bar);
       bcc_field->setCompleter(_contact_completer);
+      bcc_field->setAddressBook(_address_book);
       bcc_field->setDocument(bcc_values);
       address_layout->addRow( "Bcc:",  bcc_field );
    }
@@ -327,7 +406,6 @@ void MailEditor::updateAddressBarLayout()
       for( uint32_t i = 0; i < idents.size(); ++i )
       {
          // TODO: add user icon?
-         elog( "From field... " );
          from_field->insertItem( i, idents[i].dac_id.c_str() );
       }
      // from_field->setText( from_text );
@@ -362,31 +440,31 @@ void MailEditor::setupEditActions()
     //menuBar()->addMenu(menu);
 
     QAction* action;
-    action = actionUndo = new QAction(QIcon::fromTheme("edit-undo", QIcon(rsrcPath + "/editundo.png")),
+    action = actionUndo = new QAction(IconProvider::themeIcon("edit-undo", rsrcPath + "/editundo.png"),
                                               tr("&Undo"), this);
     action->setShortcut(QKeySequence::Undo);
 //    tool_bar->addAction(a);
     menu->addAction(action);
-    action = actionRedo = new QAction(QIcon::fromTheme("edit-redo", QIcon(rsrcPath + "/editredo.png")),
+    action = actionRedo = new QAction(IconProvider::themeIcon("edit-redo", rsrcPath + "/editredo.png"),
                                               tr("&Redo"), this);
     action->setPriority(QAction::LowPriority);
     action->setShortcut(QKeySequence::Redo);
 //    tool_bar->addAction(a);
     menu->addAction(action);
     menu->addSeparator();
-    action = actionCut = new QAction(QIcon::fromTheme("edit-cut", QIcon(rsrcPath + "/editcut.png")),
+    action = actionCut = new QAction(IconProvider::themeIcon("edit-cut", rsrcPath + "/editcut.png"),
                                              tr("Cu&t"), this);
     action->setPriority(QAction::LowPriority);
     action->setShortcut(QKeySequence::Cut);
 //    tool_bar->addAction(a);
     menu->addAction(action);
-    action = actionCopy = new QAction(QIcon::fromTheme("edit-copy", QIcon(rsrcPath + "/editcopy.png")),
+    action = actionCopy = new QAction(IconProvider::themeIcon("edit-copy", rsrcPath + "/editcopy.png"),
                                  tr("&Copy"), this);
     action->setPriority(QAction::LowPriority);
     action->setShortcut(QKeySequence::Copy);
 //    tool_bar->addAction(a);
     menu->addAction(action);
-    action = actionPaste = new QAction(QIcon::fromTheme("edit-paste", QIcon(rsrcPath + "/editpaste.png")),
+    action = actionPaste = new QAction(IconProvider::themeIcon("edit-paste", rsrcPath + "/editpaste.png"),
                                   tr("&Paste"), this);
     action->setPriority(QAction::LowPriority);
     action->setShortcut(QKeySequence::Paste);
@@ -407,9 +485,9 @@ void MailEditor::setupMoneyToolBar()
     money_amount = new QLineEdit(tool_bar);
     money_amount->setPlaceholderText( "0.00" );
     money_unit   = new QComboBox(tool_bar);
-    money_unit->insertItem( 0, QIcon::fromTheme("currency-bitcoin", QIcon( ":/images/bitcoin.png" ) ), QString("BTC") );
-    money_unit->insertItem( 1, QIcon::fromTheme("currency-litecoin", QIcon( ":/images/litecoin128.png" ) ), QString("LTC") );
-    money_unit->insertItem( 2, QIcon::fromTheme("currency-bitusd", QIcon( ":/images/bitusd.png" ) ), QString("BitUSD") );
+    money_unit->insertItem( 0, IconProvider::themeIcon("currency-bitcoin", ":/images/bitcoin.png"), QString("BTC") );
+    money_unit->insertItem( 1, IconProvider::themeIcon("currency-litecoin", ":/images/litecoin128.png"), QString("LTC") );
+    money_unit->insertItem( 2, IconProvider::themeIcon("currency-bitusd", ":/images/bitusd.png"), QString("BitUSD") );
 
     connect( money_unit, SIGNAL(currentIndexChanged(int)), this, SLOT(moneyUnitChanged(int)) );
     
@@ -456,7 +534,7 @@ void MailEditor::setupTextActions()
     QMenu* menu = new QMenu(tr("F&ormat"), this);
     //menuBar()->addMenu(menu);
 
-    actionTextBold = new QAction(QIcon::fromTheme("format-text-bold", QIcon(rsrcPath + "/textbold.png")),
+    actionTextBold = new QAction(IconProvider::themeIcon("format-text-bold", rsrcPath + "/textbold.png"),
                                  tr("&Bold"), this);
     actionTextBold->setShortcut(Qt::CTRL + Qt::Key_B);
     actionTextBold->setPriority(QAction::LowPriority);
@@ -468,8 +546,8 @@ void MailEditor::setupTextActions()
     menu->addAction(actionTextBold);
     actionTextBold->setCheckable(true);
 
-    actionTextItalic = new QAction(QIcon::fromTheme("format-text-italic",
-                                                    QIcon(rsrcPath + "/textitalic.png")),
+    actionTextItalic = new QAction(IconProvider::themeIcon("format-text-italic",
+                                                    rsrcPath + "/textitalic.png"),
                                    tr("&Italic"), this);
     actionTextItalic->setPriority(QAction::LowPriority);
     actionTextItalic->setShortcut(Qt::CTRL + Qt::Key_I);
@@ -481,8 +559,8 @@ void MailEditor::setupTextActions()
     menu->addAction(actionTextItalic);
     actionTextItalic->setCheckable(true);
 
-    actionTextUnderline = new QAction(QIcon::fromTheme("format-text-underline",
-                                                       QIcon(rsrcPath + "/textunder.png")),
+    actionTextUnderline = new QAction(IconProvider::themeIcon("format-text-underline",
+                                                       rsrcPath + "/textunder.png"),
                                       tr("&Underline"), this);
     actionTextUnderline->setShortcut(Qt::CTRL + Qt::Key_U);
     actionTextUnderline->setPriority(QAction::LowPriority);
@@ -501,28 +579,28 @@ void MailEditor::setupTextActions()
 
     // Make sure the alignLeft  is always left of the alignRight
     if (QApplication::isLeftToRight()) {
-        actionAlignLeft = new QAction(QIcon::fromTheme("format-justify-left",
-                                                       QIcon(rsrcPath + "/textleft.png")),
+        actionAlignLeft = new QAction(IconProvider::themeIcon("format-justify-left",
+                                                       rsrcPath + "/textleft.png"),
                                       tr("&Left"), grp);
-        actionAlignCenter = new QAction(QIcon::fromTheme("format-justify-center",
-                                                         QIcon(rsrcPath + "/textcenter.png")),
+        actionAlignCenter = new QAction(IconProvider::themeIcon("format-justify-center",
+                                                         rsrcPath + "/textcenter.png"),
                                         tr("C&enter"), grp);
-        actionAlignRight = new QAction(QIcon::fromTheme("format-justify-right",
-                                                        QIcon(rsrcPath + "/textright.png")),
+        actionAlignRight = new QAction(IconProvider::themeIcon("format-justify-right",
+                                                        rsrcPath + "/textright.png"),
                                        tr("&Right"), grp);
     } else {
-        actionAlignRight = new QAction(QIcon::fromTheme("format-justify-right",
-                                                        QIcon(rsrcPath + "/textright.png")),
+        actionAlignRight = new QAction(IconProvider::themeIcon("format-justify-right",
+                                                        rsrcPath + "/textright.png"),
                                        tr("&Right"), grp);
-        actionAlignCenter = new QAction(QIcon::fromTheme("format-justify-center",
-                                                         QIcon(rsrcPath + "/textcenter.png")),
+        actionAlignCenter = new QAction(IconProvider::themeIcon("format-justify-center",
+                                                         rsrcPath + "/textcenter.png"),
                                         tr("C&enter"), grp);
-        actionAlignLeft = new QAction(QIcon::fromTheme("format-justify-left",
-                                                       QIcon(rsrcPath + "/textleft.png")),
+        actionAlignLeft = new QAction(IconProvider::themeIcon("format-justify-left",
+                                                       rsrcPath + "/textleft.png"),
                                       tr("&Left"), grp);
     }
-    actionAlignJustify = new QAction(QIcon::fromTheme("format-justify-fill",
-                                                      QIcon(rsrcPath + "/textjustify.png")),
+    actionAlignJustify = new QAction(IconProvider::themeIcon("format-justify-fill",
+                                                      rsrcPath + "/textjustify.png"),
                                      tr("&Justify"), grp);
 
     actionAlignLeft->setShortcut(Qt::CTRL + Qt::Key_L);
@@ -562,16 +640,19 @@ void MailEditor::setupTextActions()
     comboSize->setObjectName("comboSize");
     tool_bar->addWidget(comboSize);
     comboSize->setEditable(true);
-
-    QFontDatabase db;
-    foreach(int size, db.standardSizes())
-        comboSize->addItem(QString::number(size));
+    // the model is shared, sizes typed in must not end up in every editor
+    comboSize->setInsertPolicy(QComboBox::NoInsert);
+    comboSize->setModel(sharedFontSizes());
 
     connect(comboSize, SIGNAL(activated(QString)), this, SLOT(textSize(QString)));
     comboSize->setCurrentIndex(comboSize->findText(QString::number(QApplication::font()
                                                                    .pointSize())));
 
-    comboFont = new QFontComboBox(tool_bar);
+    // a QFontComboBox enumerates and previews every system font per instance
+    comboFont = new QComboBox(tool_bar);
+    comboFont->setEditable(true);
+    comboFont->setInsertPolicy(QComboBox::NoInsert);
+    comboFont->setModel(sharedFontFamilies());
     tool_bar->addWidget(comboFont);
     connect(comboFont, SIGNAL(activated(QString)), this, SLOT(textFamily(QString)));
 }
@@ -607,7 +688,12 @@ bool MailEditor::maybeSave()
                                   "Do you want to save your changes?"),
                                QMessageBox::Save | QMessageBox::Discard | QMessageBox::Cancel);
     if (ret == QMessageBox::Save)
-        return fileSave();
+    {
+        // the save runs in the background, the editor closes once it has succeeded
+        if (fileSave())
+            _close_after_save = true;
+        return false;
+    }
     else if (ret == QMessageBox::Cancel)
         return false;
     return true;
@@ -616,6 +702,7 @@ bool MailEditor::maybeSave()
 //DLNFIX
 void MailEditor::sendMailMessage()
 {
+    KH_TRACE_SCOPE( "MailEditor::sendMailMessage" );
     auto app = bts::application::instance();
     auto profile = app->get_profile();
     auto idents = profile->identities();
@@ -625,32 +712,36 @@ void MailEditor::sendMailMessage()
     if( idents.size() )
     {         
         auto my_priv_key = profile->get_keychain().get_identity_key( idents[0].dac_id );
-        //foreach(to, toList)
-        QStringList images;
-        QTextBlock b = to_field->document()->begin();
-        while (b.isValid()) 
+        // recipients were resolved as their chips went in, hidden Cc/Bcc fields don't count
+        std::vector<RecipientDocument::Recipient> recipients = to_values->recipients();
+        if( actionToggleCc->isChecked() )
         {
-            for (QTextBlock::iterator i = b.begin(); !i.atEnd(); ++i) 
-            {
-                QTextCharFormat format = i.fragment().charFormat();
-                bool isImage = format.isImageFormat();
-                if (isImage)
-                    images << format.toImageFormat().name();
-            }
-            b = b.next();
+            auto cc = cc_values->recipients();
+            recipients.insert( recipients.end(), cc.begin(), cc.end() );
         }
-        foreach(auto recipient,images)
+        if( actionToggleBcc->isChecked() )
         {
-            std::string to = recipient.toStdString();
-            //check first to see if we have a dac_id
-            auto to_contact = profile->get_addressbook()->get_contact_by_dac_id(to);
-            if (!to_contact.valid())
-            { //TODO if not dac_id, check if we have a full name
+            auto bcc = bcc_values->recipients();
+            recipients.insert( recipients.end(), bcc.begin(), bcc.end() );
+        }
 
+        std::set<int>            sent_to_ids;
+        std::vector<std::string> sent_to;
+        for( auto itr = recipients.begin(); itr != recipients.end(); ++itr )
+        {
+            if( itr->contact_id == -1 )
+            {
+                wlog( "not sending to ${r}, no contact by that name", ("r",itr->label.toStdString()) );
+                continue;
+            }
+            if( !sent_to_ids.insert( itr->contact_id ).second )
+            {
+                continue;
             }
-            assert(to_contact.valid());
-            app->send_email(msg, to_contact->public_key, my_priv_key);
+            app->send_email(msg, itr->public_key, my_priv_key);
+            sent_to.push_back(itr->dac_id);
         }
+        EventJournal::instance().recordMailSent( sent_to, msg );
         //TODO add code to save to SentItems
         textEdit->document()->setModified(false);
         close();
@@ -662,15 +753,7 @@ bool MailEditor::fileSave()
     if (_fileName.isEmpty())
         return fileSaveAs();
 
-    QTextDocumentWriter writer(_fileName);
-    bool success = writer.write(textEdit->document());
-    if (success)
-        textEdit->document()->setModified(false);
-    else
-    {
-        elog( "error writing document!" );
-    }
-    return success;
+    return exportDocument(_fileName, DocumentExporter::Native);
 }
 
 bool MailEditor::fileSaveAs()
@@ -689,6 +772,57 @@ bool MailEditor::fileSaveAs()
     return fileSave();
 }
 
+bool MailEditor::exportDocument(const QString& file_name, DocumentExporter::Format format)
+{
+    if (_exporter)
+    {
+        QMessageBox::information(this, tr("Export"), tr("Please wait for the current export to finish."));
+        return false;
+    }
+    auto exporter = new DocumentExporter(*textEdit->document(), file_name, format);
+    _exporter = exporter;
+
+    // the editor stays usable meanwhile, the exporter has its own copy
+    auto progress = new QProgressDialog(format == DocumentExporter::Pdf ? tr("Exporting PDF...") : tr("Saving..."),
+                                        tr("Cancel"), 0, 0, this);
+    progress->setWindowModality(Qt::NonModal);
+    progress->setMinimumDuration(500);
+    progress->setAttribute(Qt::WA_DeleteOnClose);
+    connect(progress, &QProgressDialog::canceled, exporter, &DocumentExporter::cancel);
+
+    // both signals come from the export thread, the context object queues them to this one
+    QPointer<QProgressDialog> dialog(progress);
+    connect(exporter, &DocumentExporter::progress, this, [=](int done, int total){
+        if (dialog)
+        {
+            dialog->setMaximum(total);
+            dialog->setValue(done);
+        }
+    });
+    int revision = textEdit->document()->revision();
+    connect(exporter, &DocumentExporter::finished, this, [=](bool success, const QString& error){
+        if (dialog)
+            dialog->close();
+        if (!success)
+        {
+            _close_after_save = false;
+            elog( "error writing ${f}: ${e}", ("f",file_name.toStdString())("e",error.toStdString()) );
+            QMessageBox::warning(this, tr("Application"), tr("Unable to write %1:\n%2").arg(file_name, error));
+            return;
+        }
+        // edits made while saving still need saving
+        if (format == DocumentExporter::Native && textEdit->document()->revision() == revision)
+            textEdit->document()->setModified(false);
+        if (_close_after_save)
+        {
+            _close_after_save = false;
+            close();
+        }
+    });
+    exporter->start();
+    return true;
+}
+
 void MailEditor::filePrint()
 {
 #if !defined(QT_NO_PRINTER) && !defined(QT_NO_PRINTDIALOG)
@@ -697,12 +831,38 @@ void MailEditor::filePrint()
     if (textEdit->textCursor().hasSelection())
         dlg->addEnabledOption(QAbstractPrintDialog::PrintSelection);
     dlg->setWindowTitle(tr("Print Document"));
-    if (dlg->exec() == QDialog::Accepted)
-        textEdit->print(&printer);
+    bool accepted = dlg->exec() == QDialog::Accepted;
     delete dlg;
+    if (!accepted)
+        return;
+
+    if (printer.outputFormat() == QPrinter::PdfFormat)
+    {
+        // printing to a file can be done off the GUI thread
+        exportDocument(printer.outputFileName(), DocumentExporter::Pdf);
+        return;
+    }
+
+    // native printers only work from the GUI thread, paint a page per pass of the event loop
+    std::unique_ptr<QTextDocument> document;
+    if (printer.printRange() == QPrinter::Selection)
+    {
+        document.reset(new QTextDocument());
+        QTextCursor(document.get()).insertFragment(textEdit->textCursor().selection());
+    }
+    else
+        document.reset(textEdit->document()->clone());
+
+    QProgressDialog progress(tr("Printing..."), tr("Cancel"), 0, 0, this);
+    progress.setMinimumDuration(500);
+    DocumentExporter::printPages(*document, printer, [&](int done, int total){
+        progress.setMaximum(total);
+        progress.setValue(done);
+        QApplication::processEvents();
+        return !progress.wasCanceled();
+    });
 #endif
 }
-
 void MailEditor::filePrintPreview()
 {
 #if !defined(QT_NO_PRINTER) && !defined(QT_NO_PRINTDIALOG)
@@ -732,10 +892,7 @@ void MailEditor::filePrintPdf()
     if (!fileName.isEmpty()) {
         if (QFileInfo(fileName).suffix().isEmpty())
             fileName.append(".pdf");
-        QPrinter printer(QPrinter::HighResolution);
-        printer.setOutputFormat(QPrinter::PdfFormat);
-        printer.setOutputFileName(fileName);
-        textEdit->document()->print(&printer);
+        exportDocument(fileName, DocumentExporter::Pdf);
     }
 //! [0]
 #endif
@@ -11,10 +11,11 @@
 #include <QWidgetAction>
 #include <QPushButton>
 
+#include "DocumentExporter.hpp"
+
 QT_BEGIN_NAMESPACE
 class QAction;
 class QComboBox;
-class QFontComboBox;
 class QTextEdit;
 class QTextCharFormat;
 class QMenu;
@@ -22,8 +23,10 @@ class QPrinter;
 class QLabel;
 QT_END_NAMESPACE
 
+class AddressBookModel;
 class ContactListEdit;
 class DraftMessage;
+class RecipientDocument;
 
 
 class MailEditor : public QDialog
@@ -31,14 +34,23 @@ class MailEditor : public QDialog
     Q_OBJECT
 
 public:
-          MailEditor(QWidget* parent = nullptr, QCompleter* contact_completer = nullptr);
+          MailEditor(QWidget* parent = nullptr, QCompleter* contact_completer = nullptr,
+                     AddressBookModel* address_book = nullptr);
     void  setFocusAndShow();
     void  addToContact(int contact_id);
+    /** back to an empty message so a pooled editor can be handed out again */
+    void  reset();
 
 Q_SIGNALS:
+    /** the editor was closed (sent or discarded) and can be reset */
+    void  closed();
     void  saveDraft( const DraftMessage& message );
     void  sendMessage( const DraftMessage& message );
 
+public Q_SLOTS:
+    /** Esc and the other QDialog exits only hide the dialog, send them through close() */
+    virtual void done(int result);
+
 protected:
     virtual void closeEvent(QCloseEvent* close_event);
 
@@ -87,6 +99,10 @@ private:
     void alignmentChanged(Qt::Alignment alignment);
     void setupMoneyToolBar();
 
+    /** saves or exports a copy of the document in the background, with a progress dialog,
+        false when it could not be started */
+    bool exportDocument(const QString& file_name, DocumentExporter::Format format);
+
     void setupAddressBar();
     void updateAddressBarLayout();
 
@@ -94,9 +110,9 @@ private:
     ContactListEdit*  to_field; 
     ContactListEdit*  cc_field;
     ContactListEdit*  bcc_field;
-    QTextDocument*    to_values;
-    QTextDocument*    cc_values;
-    QTextDocument*    bcc_values;
+    RecipientDocument* to_values;
+    RecipientDocument* cc_values;
+    RecipientDocument* bcc_values;
     QLineEdit*    subject_field;
     QComboBox*    from_field;
     QFormLayout*  address_layout;
@@ -114,6 +130,7 @@ private:
     QLabel*    money_balance;
 
     QAction* actionSave;
+    QAction* actionFormat;
     QAction* actionTextBold;
     QAction* actionTextUnderline;
     QAction* actionTextItalic;
@@ -131,7 +148,7 @@ private:
     QAction* actionAttachFile;
 
     QComboBox *comboStyle;
-    QFontComboBox *comboFont;
+    QComboBox *comboFont;
     QComboBox *comboSize;
 
     QToolBar* format_tool_bar;
@@ -142,6 +159,10 @@ private:
     QString _fileName;
     QTextEdit* textEdit;
 
-    QCompleter* _contact_completer;
+    QPointer<DocumentExporter> _exporter;
+    QCompleter*       _contact_completer;
+    AddressBookModel* _address_book;
+    /// a close asked to save first, it completes when the save succeeds
+    bool              _close_after_save;
 };
 
@@ -1,6 +1,7 @@
 
 #include "MailViewer.hpp"
 #include "../ui_MailViewer.h"
+#include "../IconProvider.hpp"
 #include <QToolBar>
 
 MailViewer::MailViewer( QWidget* parent )
@@ -9,10 +10,10 @@ MailViewer::MailViewer( QWidget* parent )
    ui->setupUi( this );
 
    message_tools = new QToolBar( ui->toolbar_container ); 
-   reply = new QAction( QIcon( ":/images/mail_reply.png"), tr( "Reply"), this );
-   reply_all = new QAction( QIcon( ":/images/mail_reply_all.png"), tr( "Reply All"),this );
-   forward = new QAction( QIcon( ":/images/mail_forward.png"), tr("Forward"), this);
-   delete_mail = new QAction(QIcon( ":/images/delete_icon.png"), tr( "Delete" ), this);
+   reply = new QAction( IconProvider::icon( ":/images/mail_reply.png" ), tr( "Reply"), this );
+   reply_all = new QAction( IconProvider::icon( ":/images/mail_reply_all.png" ), tr( "Reply All"),this );
+   forward = new QAction( IconProvider::icon( ":/images/mail_forward.png" ), tr("Forward"), this);
+   delete_mail = new QAction(IconProvider::icon( ":/images/delete_icon.png" ), tr( "Delete" ), this);
 
    message_tools->addAction( reply );
    message_tools->addAction( reply_all );
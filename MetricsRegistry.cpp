@@ -0,0 +1,67 @@
+#include "MetricsRegistry.hpp"
+
+#include <deque>
+#include <map>
+#include <mutex>
+
+namespace Detail
+{
+   class MetricsRegistryImpl
+   {
+      public:
+         mutable std::mutex               _mutex;
+         /// a deque never moves its elements, handed out references stay good
+         std::deque<Metric>               _metrics;
+         std::map<std::string, Metric*>   _by_name;
+   };
+}
+
+MetricsRegistry& MetricsRegistry::instance()
+{
+   static MetricsRegistry registry;
+   return registry;
+}
+
+MetricsRegistry::MetricsRegistry()
+:my( new Detail::MetricsRegistryImpl() )
+{}
+
+MetricsRegistry::~MetricsRegistry()
+{}
+
+Metric& MetricsRegistry::counter( const std::string& name )
+{
+   return metric( name, Metric::Counter );
+}
+
+Metric& MetricsRegistry::gauge( const std::string& name )
+{
+   return metric( name, Metric::Gauge );
+}
+
+Metric& MetricsRegistry::metric( const std::string& name, Metric::Kind kind )
+{
+   std::lock_guard<std::mutex> lock( my->_mutex );
+   auto itr = my->_by_name.find( name );
+   if( itr != my->_by_name.end() )
+      return *itr->second;
+   my->_metrics.emplace_back( kind );
+   my->_by_name[name] = &my->_metrics.back();
+   return my->_metrics.back();
+}
+
+std::vector<MetricsRegistry::Sample> MetricsRegistry::snapshot()const
+{
+   std::lock_guard<std::mutex> lock( my->_mutex );
+   std::vector<Sample> samples;
+   samples.reserve( my->_by_name.size() );
+   for( auto itr = my->_by_name.begin(); itr != my->_by_name.end(); ++itr )
+   {
+      Sample sample;
+      sample.name  = itr->first;
+      sample.kind  = itr->second->kind();
+      sample.value = itr->second->value();
+      samples.push_back( sample );
+   }
+   return samples;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Detail { class MetricsRegistryImpl; }
+
+/**
+ *  A named value published by a subsystem.  Updating one is a relaxed atomic
+ *  operation, safe from any thread and cheap enough for hot paths; look the
+ *  metric up once and keep the reference:
+ *
+ *     static Metric& misses = MetricsRegistry::instance().counter( "reputation_cache.misses" );
+ *     misses.add();
+ */
+class Metric
+{
+  public:
+     enum Kind
+     {
+        /// only ever goes up, readers look at its rate
+        Counter,
+        /// a current level (queue depth, latency of the last sample...)
+        Gauge
+     };
+
+     Metric( Kind kind ):_kind(kind),_value(0){}
+
+     void    add( int64_t amount = 1 ) { _value.fetch_add( amount, std::memory_order_relaxed ); }
+     void    set( int64_t value )      { _value.store( value, std::memory_order_relaxed ); }
+     int64_t value()const              { return _value.load( std::memory_order_relaxed ); }
+     Kind    kind()const               { return _kind; }
+
+  private:
+     Kind                  _kind;
+     std::atomic<int64_t>  _value;
+};
+
+class MetricsRegistry
+{
+  public:
+     struct Sample
+     {
+        std::string  name;
+        Metric::Kind kind;
+        int64_t      value;
+     };
+
+     static MetricsRegistry& instance();
+     ~MetricsRegistry();
+
+     /** the metric named name, created on first use; references stay valid for the life of the process */
+     Metric& counter( const std::string& name );
+     Metric& gauge( const std::string& name );
+
+     /** every metric's current value, sorted by name */
+     std::vector<Sample> snapshot()const;
+
+  private:
+     MetricsRegistry();
+     Metric& metric( const std::string& name, Metric::Kind kind );
+
+     std::unique_ptr<Detail::MetricsRegistryImpl> my;
+};
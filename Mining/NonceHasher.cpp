@@ -0,0 +1,159 @@
+#include "Sha256Rounds.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace Mining
+{
+namespace
+{
+   struct ScalarOps
+   {
+      typedef uint32_t Vec;
+      enum { Lanes = 1 };
+
+      static Vec set1( uint32_t value )         { return value; }
+      static Vec add( Vec a, Vec b )            { return a + b; }
+      static Vec xor_( Vec a, Vec b )           { return a ^ b; }
+      static Vec and_( Vec a, Vec b )           { return a & b; }
+      static Vec or_( Vec a, Vec b )            { return a | b; }
+      static Vec andnot( Vec a, Vec b )         { return ~a & b; }
+      template<int N> static Vec rotr( Vec a )  { return (a >> N) | (a << (32 - N)); }
+      template<int N> static Vec shr( Vec a )   { return a >> N; }
+      static Vec  load( const uint32_t* words ) { return words[0]; }
+      static void store( Vec a, uint32_t* words ) { words[0] = a; }
+   };
+
+   void compressBytes( uint32_t state[8], const uint8_t* block )
+   {
+      uint32_t w[16];
+      for( int i = 0; i < 16; ++i )
+         w[i] = loadBigEndian( block + i * 4 );
+      compress<ScalarOps>( state, w );
+   }
+
+   /** message, 0x80, zeros and the 64 bit bit length, a multiple of 64 bytes */
+   std::vector<uint8_t> pad( const uint8_t* data, size_t size )
+   {
+      size_t padded_size = (size + 9 + 63) / 64 * 64;
+      std::vector<uint8_t> padded( padded_size, 0 );
+      if( size )
+         memcpy( padded.data(), data, size );
+      padded[size] = 0x80;
+      uint64_t bits = uint64_t( size ) * 8;
+      for( int i = 0; i < 8; ++i )
+         padded[padded_size - 1 - i] = uint8_t( bits >> (8 * i) );
+      return padded;
+   }
+
+   bool cpuSupportsAvx2()
+   {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+      __builtin_cpu_init();
+      return __builtin_cpu_supports( "avx2" );
+#elif defined(_MSC_VER)
+      int info[4];
+      __cpuid( info, 0 );
+      if( info[0] < 7 )
+         return false;
+      __cpuid( info, 1 );
+      bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv( 0 ) & 6) == 6;
+      __cpuidex( info, 7, 0 );
+      return os_saves_ymm && (info[1] & (1 << 5));
+#else
+      return false;
+#endif
+   }
+
+   bool cpuSupportsSse42()
+   {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+      __builtin_cpu_init();
+      return __builtin_cpu_supports( "sse4.2" );
+#elif defined(_MSC_VER)
+      int info[4];
+      __cpuid( info, 1 );
+      return (info[2] & (1 << 20)) != 0;
+#else
+      return false;
+#endif
+   }
+}
+
+NonceHashContext::NonceHashContext( const std::vector<uint8_t>& header )
+{
+   if( header.size() < 4 )
+      throw std::invalid_argument( "mining header must end with a 4 byte nonce" );
+
+   std::vector<uint8_t> padded = pad( header.data(), header.size() );
+   size_t nonce_offset = header.size() - 4;
+   size_t first_tail   = nonce_offset / 64;
+   for( int k = 0; k < 4; ++k )
+      padded[nonce_offset + k] = 0;
+
+   memcpy( midstate, InitialState, sizeof(midstate) );
+   for( size_t block = 0; block < first_tail; ++block )
+      compressBytes( midstate, padded.data() + block * 64 );
+
+   tail_blocks = uint32_t( padded.size() / 64 - first_tail );
+   memset( tail, 0, sizeof(tail) );
+   for( uint32_t block = 0; block < tail_blocks; ++block )
+      for( int i = 0; i < 16; ++i )
+         tail[block][i] = loadBigEndian( padded.data() + (first_tail + block) * 64 + i * 4 );
+
+   for( int k = 0; k < 4; ++k )
+   {
+      size_t tail_offset = nonce_offset + k - first_tail * 64;
+      nonce_word[k]  = uint32_t( tail_offset / 4 );
+      nonce_shift[k] = uint32_t( (3 - tail_offset % 4) * 8 );
+   }
+}
+
+void hashNoncesScalar( const NonceHashContext& context, uint32_t first_nonce, uint32_t count, uint8_t* digests )
+{
+   hashNonceGroups<ScalarOps>( context, first_nonce, count, digests );
+}
+
+void sha256( const uint8_t* data, size_t size, uint8_t digest[32] )
+{
+   std::vector<uint8_t> padded = pad( data, size );
+   uint32_t state[8];
+   memcpy( state, InitialState, sizeof(state) );
+   for( size_t block = 0; block < padded.size() / 64; ++block )
+      compressBytes( state, padded.data() + block * 64 );
+   for( int i = 0; i < 8; ++i )
+      storeBigEndian( state[i], digest + i * 4 );
+}
+
+const std::vector<HashKernel>& supportedKernels()
+{
+   static std::vector<HashKernel> kernels;
+   if( kernels.empty() )
+   {
+      HashKernel scalar = { "scalar", 1, &hashNoncesScalar };
+      kernels.push_back( scalar );
+      if( cpuSupportsSse42() )
+      {
+         HashKernel sse = { "sse4.2", 4, &hashNoncesSse };
+         kernels.push_back( sse );
+      }
+      if( cpuSupportsAvx2() )
+      {
+         HashKernel avx2 = { "avx2", 8, &hashNoncesAvx2 };
+         kernels.push_back( avx2 );
+      }
+   }
+   return kernels;
+}
+
+const HashKernel& bestKernel()
+{
+   return supportedKernels().back();
+}
+
+}
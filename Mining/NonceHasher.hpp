@@ -0,0 +1,51 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace Mining
+{
+   /**
+    *  Precomputed state for SHA-256 hashing one header with many nonces.
+    *
+    *  The nonce is the last 4 bytes of the header, little endian.  Every block
+    *  before the one holding the nonce is compressed once into the midstate, so
+    *  a kernel only runs the one or two padded tail blocks per nonce.
+    */
+   struct NonceHashContext
+   {
+      /** @param header at least 4 bytes, its last 4 bytes are replaced by the nonce */
+      NonceHashContext( const std::vector<uint8_t>& header );
+
+      uint32_t midstate[8];
+      /// padded tail blocks as big endian words, with the nonce bytes zeroed
+      uint32_t tail[2][16];
+      uint32_t tail_blocks;
+      /// word (0-31 across the tail blocks) and bit shift of each nonce byte
+      uint32_t nonce_word[4];
+      uint32_t nonce_shift[4];
+   };
+
+   /** writes count 32 byte digests for first_nonce, first_nonce + 1, ... */
+   typedef void (*HashNonces)( const NonceHashContext& context, uint32_t first_nonce, uint32_t count, uint8_t* digests );
+
+   struct HashKernel
+   {
+      const char* name;
+      uint32_t    lanes;
+      HashNonces  hash_nonces;
+   };
+
+   void hashNoncesScalar( const NonceHashContext& context, uint32_t first_nonce, uint32_t count, uint8_t* digests );
+   /** 4 nonces per pass, SSE2 integer ops (the build targets SSE4.2) */
+   void hashNoncesSse( const NonceHashContext& context, uint32_t first_nonce, uint32_t count, uint8_t* digests );
+   /** 8 nonces per pass, only call when the CPU reports AVX2 */
+   void hashNoncesAvx2( const NonceHashContext& context, uint32_t first_nonce, uint32_t count, uint8_t* digests );
+
+   /** kernels this CPU can run, the scalar reference first and the widest last */
+   const std::vector<HashKernel>& supportedKernels();
+   const HashKernel&              bestKernel();
+
+   /** plain one-shot SHA-256, what every kernel has to match */
+   void sha256( const uint8_t* data, size_t size, uint8_t digest[32] );
+}
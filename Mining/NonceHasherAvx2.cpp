@@ -0,0 +1,35 @@
+// built with -mavx2 (see CMakeLists.txt), only reached after the runtime check in supportedKernels()
+#include "Sha256Rounds.hpp"
+
+#include <immintrin.h>
+
+namespace Mining
+{
+namespace
+{
+   struct Avx2Ops
+   {
+      typedef __m256i Vec;
+      enum { Lanes = 8 };
+
+      static Vec set1( uint32_t value )         { return _mm256_set1_epi32( int( value ) ); }
+      static Vec add( Vec a, Vec b )            { return _mm256_add_epi32( a, b ); }
+      static Vec xor_( Vec a, Vec b )           { return _mm256_xor_si256( a, b ); }
+      static Vec and_( Vec a, Vec b )           { return _mm256_and_si256( a, b ); }
+      static Vec or_( Vec a, Vec b )            { return _mm256_or_si256( a, b ); }
+      static Vec andnot( Vec a, Vec b )         { return _mm256_andnot_si256( a, b ); }
+      template<int N> static Vec rotr( Vec a )  { return _mm256_or_si256( _mm256_srli_epi32( a, N ), _mm256_slli_epi32( a, 32 - N ) ); }
+      template<int N> static Vec shr( Vec a )   { return _mm256_srli_epi32( a, N ); }
+      static Vec  load( const uint32_t* words ) { return _mm256_loadu_si256( (const __m256i*)words ); }
+      static void store( Vec a, uint32_t* words ) { _mm256_storeu_si256( (__m256i*)words, a ); }
+   };
+}
+
+void hashNoncesAvx2( const NonceHashContext& context, uint32_t first_nonce, uint32_t count, uint8_t* digests )
+{
+   uint32_t done = hashNonceGroups<Avx2Ops>( context, first_nonce, count, digests );
+   if( done < count )
+      hashNoncesScalar( context, first_nonce + done, count - done, digests + done * 32 );
+}
+
+}
@@ -0,0 +1,34 @@
+#include "Sha256Rounds.hpp"
+
+#include <emmintrin.h>
+
+namespace Mining
+{
+namespace
+{
+   struct SseOps
+   {
+      typedef __m128i Vec;
+      enum { Lanes = 4 };
+
+      static Vec set1( uint32_t value )         { return _mm_set1_epi32( int( value ) ); }
+      static Vec add( Vec a, Vec b )            { return _mm_add_epi32( a, b ); }
+      static Vec xor_( Vec a, Vec b )           { return _mm_xor_si128( a, b ); }
+      static Vec and_( Vec a, Vec b )           { return _mm_and_si128( a, b ); }
+      static Vec or_( Vec a, Vec b )            { return _mm_or_si128( a, b ); }
+      static Vec andnot( Vec a, Vec b )         { return _mm_andnot_si128( a, b ); }
+      template<int N> static Vec rotr( Vec a )  { return _mm_or_si128( _mm_srli_epi32( a, N ), _mm_slli_epi32( a, 32 - N ) ); }
+      template<int N> static Vec shr( Vec a )   { return _mm_srli_epi32( a, N ); }
+      static Vec  load( const uint32_t* words ) { return _mm_loadu_si128( (const __m128i*)words ); }
+      static void store( Vec a, uint32_t* words ) { _mm_storeu_si128( (__m128i*)words, a ); }
+   };
+}
+
+void hashNoncesSse( const NonceHashContext& context, uint32_t first_nonce, uint32_t count, uint8_t* digests )
+{
+   uint32_t done = hashNonceGroups<SseOps>( context, first_nonce, count, digests );
+   if( done < count )
+      hashNoncesScalar( context, first_nonce + done, count - done, digests + done * 32 );
+}
+
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include "NonceHasher.hpp"
+
+/**
+ *  SHA-256 compression and the multi nonce loop, written once against a small
+ *  "Ops" interface (add, xor, rotate, ...) and instantiated per instruction set
+ *  in its own translation unit:
+ *
+ *     struct Ops { typedef ... Vec; enum { Lanes = n };
+ *                  static Vec set1( uint32_t ); add, xor_, and_, or_, andnot( a, b ) = ~a & b,
+ *                  template<int N> rotr( Vec ), template<int N> shr( Vec ),
+ *                  load( const uint32_t* ), store( Vec, uint32_t* ) };
+ *
+ *  Everything here has internal linkage on purpose: each kernel file is built
+ *  with different -m flags and must not share (and let the linker pick) a copy
+ *  compiled for a wider instruction set.
+ */
+namespace Mining
+{
+namespace
+{
+   const uint32_t RoundConstants[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+      0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+      0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+      0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+      0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+      0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+   const uint32_t InitialState[8] = {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+   inline void storeBigEndian( uint32_t word, uint8_t* out )
+   {
+      out[0] = uint8_t( word >> 24 );
+      out[1] = uint8_t( word >> 16 );
+      out[2] = uint8_t( word >> 8 );
+      out[3] = uint8_t( word );
+   }
+
+   inline uint32_t loadBigEndian( const uint8_t* in )
+   {
+      return (uint32_t(in[0]) << 24) | (uint32_t(in[1]) << 16) | (uint32_t(in[2]) << 8) | uint32_t(in[3]);
+   }
+
+   /** one 64 byte block, w is used as the rolling message schedule and clobbered */
+   template<typename Ops>
+   inline void compress( typename Ops::Vec state[8], typename Ops::Vec w[16] )
+   {
+      typedef typename Ops::Vec Vec;
+      Vec a = state[0], b = state[1], c = state[2], d = state[3];
+      Vec e = state[4], f = state[5], g = state[6], h = state[7];
+
+      for( int i = 0; i < 64; ++i )
+      {
+         if( i >= 16 )
+         {
+            Vec w15 = w[(i - 15) & 15];
+            Vec w2  = w[(i - 2) & 15];
+            Vec s0  = Ops::xor_( Ops::xor_( Ops::template rotr<7>( w15 ), Ops::template rotr<18>( w15 ) ),
+                                 Ops::template shr<3>( w15 ) );
+            Vec s1  = Ops::xor_( Ops::xor_( Ops::template rotr<17>( w2 ), Ops::template rotr<19>( w2 ) ),
+                                 Ops::template shr<10>( w2 ) );
+            w[i & 15] = Ops::add( Ops::add( w[i & 15], s0 ), Ops::add( w[(i - 7) & 15], s1 ) );
+         }
+
+         Vec big_sigma1 = Ops::xor_( Ops::xor_( Ops::template rotr<6>( e ), Ops::template rotr<11>( e ) ),
+                                     Ops::template rotr<25>( e ) );
+         Vec choose     = Ops::xor_( Ops::and_( e, f ), Ops::andnot( e, g ) );
+         Vec t1         = Ops::add( Ops::add( h, big_sigma1 ),
+                                    Ops::add( choose, Ops::add( Ops::set1( RoundConstants[i] ), w[i & 15] ) ) );
+         Vec big_sigma0 = Ops::xor_( Ops::xor_( Ops::template rotr<2>( a ), Ops::template rotr<13>( a ) ),
+                                     Ops::template rotr<22>( a ) );
+         Vec majority   = Ops::or_( Ops::and_( a, b ), Ops::and_( c, Ops::or_( a, b ) ) );
+         Vec t2         = Ops::add( big_sigma0, majority );
+
+         h = g; g = f; f = e;
+         e = Ops::add( d, t1 );
+         d = c; c = b; b = a;
+         a = Ops::add( t1, t2 );
+      }
+
+      state[0] = Ops::add( state[0], a ); state[1] = Ops::add( state[1], b );
+      state[2] = Ops::add( state[2], c ); state[3] = Ops::add( state[3], d );
+      state[4] = Ops::add( state[4], e ); state[5] = Ops::add( state[5], f );
+      state[6] = Ops::add( state[6], g ); state[7] = Ops::add( state[7], h );
+   }
+
+   /**
+    *  Hashes count / Lanes groups of consecutive nonces, one nonce per lane, and
+    *  returns how many nonces were done; the caller finishes the remainder.
+    */
+   template<typename Ops>
+   uint32_t hashNonceGroups( const NonceHashContext& context, uint32_t first_nonce, uint32_t count, uint8_t* digests )
+   {
+      typedef typename Ops::Vec Vec;
+      const uint32_t lanes  = Ops::Lanes;
+      const uint32_t groups = count / lanes;
+
+      for( uint32_t group = 0; group < groups; ++group )
+      {
+         uint32_t nonce_base = first_nonce + group * lanes;
+
+         // the nonce touches at most two words, build their per lane values
+         uint32_t lane_words[32][Ops::Lanes];
+         bool     is_nonce_word[32] = {};
+         for( int k = 0; k < 4; ++k )
+         {
+            uint32_t word = context.nonce_word[k];
+            if( !is_nonce_word[word] )
+            {
+               is_nonce_word[word] = true;
+               for( uint32_t lane = 0; lane < lanes; ++lane )
+                  lane_words[word][lane] = context.tail[word / 16][word % 16];
+            }
+            for( uint32_t lane = 0; lane < lanes; ++lane )
+            {
+               uint32_t nonce_byte = ((nonce_base + lane) >> (8 * k)) & 0xff;
+               lane_words[word][lane] |= nonce_byte << context.nonce_shift[k];
+            }
+         }
+
+         Vec state[8];
+         for( int i = 0; i < 8; ++i )
+            state[i] = Ops::set1( context.midstate[i] );
+
+         for( uint32_t block = 0; block < context.tail_blocks; ++block )
+         {
+            Vec w[16];
+            for( int i = 0; i < 16; ++i )
+            {
+               uint32_t word = block * 16 + i;
+               w[i] = is_nonce_word[word] ? Ops::load( lane_words[word] ) : Ops::set1( context.tail[block][i] );
+            }
+            compress<Ops>( state, w );
+         }
+
+         for( int i = 0; i < 8; ++i )
+         {
+            uint32_t words[Ops::Lanes];
+            Ops::store( state[i], words );
+            for( uint32_t lane = 0; lane < lanes; ++lane )
+               storeBigEndian( words[lane], digests + (group * lanes + lane) * 32 + i * 4 );
+         }
+      }
+      return groups * lanes;
+   }
+}
+}
@@ -0,0 +1,175 @@
+/**
+ *  mining_bench [seconds_per_run] [max_threads]
+ *
+ *  Checks every kernel the CPU supports against the reference SHA-256 and then
+ *  reports hashes per second for each kernel at 1, 2, 4, ... threads, every
+ *  thread hashing its own slice of the nonce space.
+ */
+#include "NonceHasher.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace
+{
+   const uint32_t BatchSize = 1024;
+
+   std::vector<uint8_t> makeHeader( size_t size )
+   {
+      std::vector<uint8_t> header( size );
+      for( size_t i = 0; i < size; ++i )
+         header[i] = uint8_t( i * 7 + 3 );
+      return header;
+   }
+
+   bool checkReference()
+   {
+      // FIPS 180-2 test vector
+      static const uint8_t abc_digest[32] = {
+         0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+         0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad };
+      uint8_t digest[32];
+      Mining::sha256( (const uint8_t*)"abc", 3, digest );
+      return memcmp( digest, abc_digest, 32 ) == 0;
+   }
+
+   /** every kernel, for headers whose nonce sits anywhere in a block and across block edges */
+   bool checkKernels()
+   {
+      const uint32_t count = 3 * 8 + 5;
+      bool ok = true;
+      for( size_t size = 4; size <= 200; ++size )
+      {
+         auto header = makeHeader( size );
+         Mining::NonceHashContext context( header );
+         uint32_t first_nonce = 0xfffffff0u + uint32_t( size );
+
+         std::vector<uint8_t> expected( count * 32 );
+         for( uint32_t i = 0; i < count; ++i )
+         {
+            uint32_t nonce = first_nonce + i;
+            for( int k = 0; k < 4; ++k )
+               header[size - 4 + k] = uint8_t( nonce >> (8 * k) );
+            Mining::sha256( header.data(), header.size(), &expected[i * 32] );
+         }
+
+         const auto& kernels = Mining::supportedKernels();
+         for( auto itr = kernels.begin(); itr != kernels.end(); ++itr )
+         {
+            std::vector<uint8_t> digests( count * 32 );
+            itr->hash_nonces( context, first_nonce, count, digests.data() );
+            if( digests != expected )
+            {
+               printf( "MISMATCH: kernel %s, header size %u\n", itr->name, unsigned( size ) );
+               ok = false;
+            }
+         }
+      }
+      return ok;
+   }
+
+   void printUsage( const char* program )
+   {
+      fprintf( stderr, "usage: %s [seconds_per_run > 0] [max_threads > 0]\n", program );
+   }
+
+   /** @return false unless all of text is a number above zero */
+   bool parsePositive( const char* text, double& value )
+   {
+      char* end = nullptr;
+      value = strtod( text, &end );
+      return end != text && *end == '\0' && value > 0 && value <= std::numeric_limits<int>::max() / 1000;
+   }
+
+   bool parsePositive( const char* text, unsigned& value )
+   {
+      char* end = nullptr;
+      long parsed = strtol( text, &end, 10 );
+      value = unsigned( parsed );
+      return end != text && *end == '\0' && parsed > 0 && parsed <= 4096;
+   }
+
+   double hashesPerSecond( const Mining::HashKernel& kernel, unsigned thread_count, double seconds )
+   {
+      // 80 bytes, the size of a typical block header
+      Mining::NonceHashContext context( makeHeader( 80 ) );
+      std::atomic<bool>     stop( false );
+      std::atomic<uint64_t> total( 0 );
+
+      std::vector<std::thread> threads;
+      for( unsigned t = 0; t < thread_count; ++t )
+      {
+         threads.push_back( std::thread( [&, t](){
+            std::vector<uint8_t> digests( BatchSize * 32 );
+            uint32_t nonce  = uint32_t( (uint64_t(t) << 32) / thread_count );
+            uint64_t hashes = 0;
+            while( !stop.load( std::memory_order_relaxed ) )
+            {
+               kernel.hash_nonces( context, nonce, BatchSize, digests.data() );
+               nonce  += BatchSize;
+               hashes += BatchSize;
+            }
+            total += hashes;
+         } ) );
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      std::this_thread::sleep_for( std::chrono::milliseconds( int( seconds * 1000 ) ) );
+      stop = true;
+      for( auto itr = threads.begin(); itr != threads.end(); ++itr )
+         itr->join();
+      double elapsed = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+      return total / elapsed;
+   }
+}
+
+int main( int argc, char** argv )
+{
+   double   seconds     = 1.0;
+   unsigned max_threads = std::max( 1u, std::thread::hardware_concurrency() );
+   if( argc > 3 ||
+       (argc > 1 && !parsePositive( argv[1], seconds )) ||
+       (argc > 2 && !parsePositive( argv[2], max_threads )) )
+   {
+      printUsage( argv[0] );
+      return 2;
+   }
+
+   if( !checkReference() )
+   {
+      printf( "reference SHA-256 is broken\n" );
+      return 1;
+   }
+   if( !checkKernels() )
+      return 1;
+
+   const auto& kernels = Mining::supportedKernels();
+   printf( "all %u kernels match the reference, best is %s\n\n", unsigned( kernels.size() ), Mining::bestKernel().name );
+   printf( "%-8s %7s %14s %10s\n", "kernel", "threads", "hashes/s", "vs scalar" );
+
+   std::vector<double> scalar_rates;
+   for( auto itr = kernels.begin(); itr != kernels.end(); ++itr )
+   {
+      size_t run = 0;
+      for( unsigned threads = 1; ; threads *= 2, ++run )
+      {
+         if( threads > max_threads )
+            threads = max_threads;
+         double rate = hashesPerSecond( *itr, threads, seconds );
+         if( itr == kernels.begin() )
+            scalar_rates.push_back( rate );
+         printf( "%-8s %7u %14.0f %9.2fx\n", itr->name, threads, rate, rate / scalar_rates[run] );
+         fflush( stdout );
+         if( threads == max_threads )
+            break;
+      }
+   }
+   return 0;
+}
@@ -0,0 +1,308 @@
+#include "MiningScheduler.hpp"
+#include "MetricsRegistry.hpp"
+#include "NameRegistryCache.hpp"
+
+#include <bts/application.hpp>
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+#include <fc/reflect/reflect.hpp>
+#include <fc/reflect/variant.hpp>
+#include <fc/time.hpp>
+
+#include <QCoreApplication>
+#include <QEvent>
+
+#include <algorithm>
+
+namespace Detail
+{
+   struct IdentityMiningState
+   {
+      IdentityMiningState():registered(false),full_speed_ms(0),active(false){}
+
+      std::string        dac_id;
+      /// registered to our key when last checked
+      bool               registered;
+      fc::time_point_sec registration_checked;
+      /// mining time converted to 100% intensity
+      uint64_t           full_speed_ms;
+      /// being mined in this session, not persisted
+      bool               active;
+   };
+}
+FC_REFLECT( Detail::IdentityMiningState, (dac_id)(registered)(registration_checked)(full_speed_ms) )
+
+namespace
+{
+   /// what is written to the state file
+   struct MiningSettings
+   {
+      MiningSettings():enabled(false),cpu_budget(100){}
+
+      bool                                      enabled;
+      int                                       cpu_budget;
+      std::vector<Detail::IdentityMiningState>  identities;
+   };
+}
+FC_REFLECT( MiningSettings, (enabled)(cpu_budget)(identities) )
+
+namespace
+{
+   /// how long the GUI must be left alone before mining resumes
+   const int ResumeDelayMs     = 1500;
+   const int StatusIntervalMs  = 1000;
+   /// the reported duty cycle is averaged over this window
+   const int AverageWindowMs   = 60 * 1000;
+   const int SaveIntervalMs    = 60 * 1000;
+   /// registrations can lapse or move to another key, a confirmed one is trusted this long
+   const int RegistrationTtlSec = 24 * 60 * 60;
+
+   fc::path gStateFile;
+}
+
+MiningScheduler::MiningScheduler( QObject* parent )
+:QObject(parent),
+ _enabled(false),
+ _cpu_budget(100),
+ _paused(false),
+ _intensity(0),
+ _weighted_ms(0),
+ _window_ms(0),
+ _last_sample_ms(0)
+{
+   _resume_timer.setSingleShot( true );
+   _resume_timer.setInterval( ResumeDelayMs );
+   connect( &_resume_timer, &QTimer::timeout, [=](){ resume(); } );
+
+   _status_timer.setInterval( StatusIntervalMs );
+   connect( &_status_timer, &QTimer::timeout, [=](){ reportStatus(); } );
+   _status_timer.start();
+
+   _save_timer.setInterval( SaveIntervalMs );
+   connect( &_save_timer, &QTimer::timeout, [=](){ saveState(); } );
+   _save_timer.start();
+
+   _window_clock.start();
+   qApp->installEventFilter( this );
+   loadState();
+
+   // bts persists the intensity, which may be a pause left over from last session
+   _intensity = _enabled ? _cpu_budget : 0;
+   bts::application::instance()->set_mining_intensity( _intensity );
+   // don't leave a pause behind for the next start of bts.  The window owning
+   // us is never deleted before exit, so this is also the last chance to save
+   connect( qApp, &QCoreApplication::aboutToQuit, this, [=](){
+      bts::application::instance()->set_mining_intensity( _enabled ? _cpu_budget : 0 );
+      saveState();
+   } );
+}
+
+MiningScheduler::~MiningScheduler()
+{
+   qApp->removeEventFilter( this );
+}
+
+void MiningScheduler::setStateFile( const fc::path& state_file )
+{
+   gStateFile = state_file;
+}
+
+void MiningScheduler::loadState()
+{
+   // until the switch has been saved here, the intensity bts persisted is the user's last choice
+   int bts_intensity = bts::application::instance()->get_mining_intensity();
+   _enabled    = bts_intensity != 0;
+   _cpu_budget = _enabled ? std::max( 1, std::min( bts_intensity, 100 ) ) : 100;
+
+   if( gStateFile == fc::path() || !fc::exists( gStateFile ) )
+      return;
+   try {
+      auto settings = fc::json::from_file( gStateFile ).as<MiningSettings>();
+      _enabled    = settings.enabled;
+      _cpu_budget = std::max( 1, std::min( settings.cpu_budget, 100 ) );
+      for( auto itr = settings.identities.begin(); itr != settings.identities.end(); ++itr )
+      {
+         _identities[itr->dac_id] = std::make_shared<Detail::IdentityMiningState>( *itr );
+      }
+   }
+   catch ( const fc::exception& e )
+   {
+      wlog( "ignoring unreadable mining state: ${e}", ("e",e.to_detail_string()) );
+   }
+}
+
+void MiningScheduler::saveState()
+{
+   if( gStateFile == fc::path() )
+      return;
+   accumulate();
+
+   MiningSettings settings;
+   settings.enabled    = _enabled;
+   settings.cpu_budget = _cpu_budget;
+   for( auto itr = _identities.begin(); itr != _identities.end(); ++itr )
+   {
+      settings.identities.push_back( *itr->second );
+   }
+   try {
+      // written next to the real file and renamed, a crash mid-save keeps the old state
+      auto tmp_file = gStateFile.parent_path() / (gStateFile.filename().generic_string() + ".tmp");
+      fc::json::save_to_file( settings, tmp_file );
+      fc::rename( tmp_file, gStateFile );
+   }
+   catch ( const fc::exception& e )
+   {
+      wlog( "unable to save mining state: ${e}", ("e",e.to_detail_string()) );
+   }
+}
+
+bool MiningScheduler::needsMining( const std::string& dac_id, const fc::ecc::public_key& key )
+{
+   auto& state = _identities[dac_id];
+   if( !state )
+   {
+      state = std::make_shared<Detail::IdentityMiningState>();
+      state->dac_id = dac_id;
+   }
+   fc::time_point_sec now = fc::time_point::now();
+   if( state->registered && now < state->registration_checked + RegistrationTtlSec )
+      return false;
+
+   auto record = NameRegistryCache::instance().lookupName( dac_id );
+   bool registered = record && fc::ecc::public_key( record->pub_key ).serialize() == key.serialize();
+   if( registered )
+   {
+      if( !state->registered )
+         ilog( "${id} is registered after ${ms} ms of mining, not mining it again", ("id",dac_id)("ms",state->full_speed_ms) );
+      state->active = false;
+   }
+   else
+   {
+      if( state->registered )
+         wlog( "${id} is no longer registered to our key, mining it again", ("id",dac_id) );
+      state->active = true;
+   }
+   state->registered           = registered;
+   state->registration_checked = now;
+   saveState();
+   return !registered;
+}
+
+void MiningScheduler::setEnabled( bool enabled )
+{
+   _enabled = enabled;
+   applyIntensity();
+   saveState();
+}
+
+void MiningScheduler::setCpuBudget( int percent )
+{
+   _cpu_budget = std::max( 1, std::min( percent, 100 ) );
+   applyIntensity();
+   saveState();
+}
+
+bool MiningScheduler::eventFilter( QObject* object, QEvent* event )
+{
+   switch( event->type() )
+   {
+      case QEvent::KeyPress:
+      case QEvent::MouseButtonPress:
+      case QEvent::MouseButtonDblClick:
+      case QEvent::Wheel:
+      case QEvent::TouchBegin:
+         userInteracted();
+         break;
+      default:
+         break;
+   }
+   return QObject::eventFilter( object, event );
+}
+
+void MiningScheduler::userInteracted()
+{
+   if( !_enabled )
+      return;
+   _resume_timer.start();
+   if( !_paused )
+   {
+      _paused = true;
+      applyIntensity();
+   }
+}
+
+void MiningScheduler::resume()
+{
+   _paused = false;
+   applyIntensity();
+}
+
+void MiningScheduler::applyIntensity()
+{
+   int intensity = (_enabled && !_paused) ? _cpu_budget : 0;
+   if( intensity == _intensity )
+      return;
+   accumulate();
+   _intensity = intensity;
+   bts::application::instance()->set_mining_intensity( intensity );
+   reportStatus();
+}
+
+void MiningScheduler::accumulate()
+{
+   qint64 now     = _window_clock.elapsed();
+   qint64 elapsed = now - _last_sample_ms;
+   _last_sample_ms = now;
+
+   _weighted_ms += _intensity * elapsed;
+   if( _intensity )
+   {
+      for( auto itr = _identities.begin(); itr != _identities.end(); ++itr )
+      {
+         if( itr->second->active )
+            itr->second->full_speed_ms += _intensity * elapsed / 100;
+      }
+   }
+   _window_ms   += elapsed;
+   if( _window_ms > AverageWindowMs )
+   {
+      // decay instead of keeping samples, older activity fades out of the average
+      _weighted_ms = _weighted_ms * AverageWindowMs / _window_ms;
+      _window_ms   = AverageWindowMs;
+   }
+}
+
+int MiningScheduler::effectiveDutyCycle()const
+{
+   if( _window_ms == 0 )
+      return _intensity;
+   return int( _weighted_ms / _window_ms );
+}
+
+QString MiningScheduler::statusText()const
+{
+   if( !_enabled )
+      return tr("Mining off");
+   QString status = tr("Mining %1% of CPU budget %2%").arg( effectiveDutyCycle() ).arg( _cpu_budget );
+   uint64_t mined_ms = 0;
+   for( auto itr = _identities.begin(); itr != _identities.end(); ++itr )
+   {
+      if( itr->second->active )
+         mined_ms += itr->second->full_speed_ms;
+   }
+   if( mined_ms )
+      status += tr(", %1 min at full speed so far").arg( mined_ms / 60000 );
+   if( _paused )
+      status += tr(" (paused)");
+   return status;
+}
+
+void MiningScheduler::reportStatus()
+{
+   static Metric& duty_cycle = MetricsRegistry::instance().gauge( "mining.duty_cycle_pct" );
+   static Metric& cpu_budget = MetricsRegistry::instance().gauge( "mining.cpu_budget_pct" );
+   accumulate();
+   duty_cycle.set( _enabled ? effectiveDutyCycle() : 0 );
+   cpu_budget.set( _cpu_budget );
+   Q_EMIT statusChanged( statusText() );
+}
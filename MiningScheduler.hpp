@@ -0,0 +1,95 @@
+#pragma once
+#include <fc/crypto/elliptic.hpp>
+#include <fc/filesystem.hpp>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace Detail { struct IdentityMiningState; }
+
+/**
+ *  Decides how much CPU bitname mining gets.
+ *
+ *  Mining runs inside bts, the only control it exposes is the mining intensity
+ *  (a 0-100 duty cycle applied to its miner threads).  The scheduler turns the
+ *  user's on/off switch and CPU budget into that intensity, drops it to zero
+ *  while the user is typing or clicking and restores it once the GUI has been
+ *  idle for a moment.  The effective duty cycle, averaged over the last
+ *  minute, is reported through statusChanged().
+ *
+ *  The switch, the budget and per identity progress (full speed mining time
+ *  spent, whether and when the name was seen registered to our key) are kept
+ *  in mining_state.json under the profile data_dir and saved every minute, so
+ *  a restart does not start over on names that are already done.  The intensity
+ *  bts persists is only read when there is no state file yet, after that it
+ *  is only written, a pause must not turn mining off for the next session.
+ */
+class MiningScheduler : public QObject
+{
+  Q_OBJECT
+  public:
+     MiningScheduler( QObject* parent = nullptr );
+     ~MiningScheduler();
+
+     void setEnabled( bool enabled );
+     bool isEnabled()const { return _enabled; }
+
+     /** percent of the miner's full speed, 1-100 */
+     void setCpuBudget( int percent );
+     int  cpuBudget()const { return _cpu_budget; }
+
+     bool isPaused()const { return _paused; }
+     /** time weighted intensity over the last minute, 0-100 */
+     int  effectiveDutyCycle()const;
+
+     QString statusText()const;
+
+     /** where per identity progress is kept, set once at startup */
+     static void setStateFile( const fc::path& state_file );
+
+     /**
+      *  @return false if dac_id is registered to key, in which case
+      *          mine_name() does not need to be called.  Otherwise the
+      *          identity's mining time starts being accounted.  A confirmed
+      *          registration is looked up again once it is a day old, it may
+      *          have lapsed or moved to another key.
+      */
+     bool needsMining( const std::string& dac_id, const fc::ecc::public_key& key );
+
+  Q_SIGNALS:
+     void statusChanged( const QString& status );
+
+  protected:
+     virtual bool eventFilter( QObject* object, QEvent* event );
+
+  private:
+     void userInteracted();
+     void resume();
+     void applyIntensity();
+     void accumulate();
+     void reportStatus();
+     void loadState();
+     void saveState();
+
+     bool          _enabled;
+     int           _cpu_budget;
+     bool          _paused;
+     int           _intensity;
+
+     QTimer        _resume_timer;
+     QTimer        _status_timer;
+
+     /// intensity * msecs and msecs over the current averaging window
+     QElapsedTimer _window_clock;
+     qint64        _weighted_ms;
+     qint64        _window_ms;
+     qint64        _last_sample_ms;
+
+     QTimer        _save_timer;
+     std::map<std::string, std::shared_ptr<Detail::IdentityMiningState> > _identities;
+};
@@ -0,0 +1,77 @@
+#include "NameRegistryCache.hpp"
+#include "MetricsRegistry.hpp"
+
+#include <fc/time.hpp>
+
+#include <unordered_map>
+
+namespace
+{
+   /// a registration can move to another key when it expires, don't hold on to it for long
+   const fc::microseconds RecordLifetime = fc::seconds(5*60);
+}
+
+namespace Detail
+{
+   class NameRegistryCacheImpl
+   {
+      public:
+         struct CachedRecord
+         {
+            bts::bitname::name_record  record;
+            fc::time_point             expires;
+         };
+
+         std::unordered_map<std::string, CachedRecord> _records;
+   };
+}
+
+NameRegistryCache& NameRegistryCache::instance()
+{
+   static NameRegistryCache cache;
+   return cache;
+}
+
+NameRegistryCache::NameRegistryCache()
+:my( new Detail::NameRegistryCacheImpl() )
+{
+}
+
+NameRegistryCache::~NameRegistryCache()
+{
+}
+
+void NameRegistryCache::clear()
+{
+   my->_records.clear();
+}
+
+fc::optional<bts::bitname::name_record> NameRegistryCache::lookupName( const std::string& name )
+{
+   static Metric& hits   = MetricsRegistry::instance().counter( "name_registry_cache.hits" );
+   static Metric& misses = MetricsRegistry::instance().counter( "name_registry_cache.misses" );
+
+   auto now = fc::time_point::now();
+   auto itr = my->_records.find( name );
+   if( itr != my->_records.end() && itr->second.expires > now )
+   {
+      hits.add();
+      return itr->second.record;
+   }
+   misses.add();
+
+   auto record = bts::application::instance()->lookup_name( name );
+   if( record )
+   {
+      Detail::NameRegistryCacheImpl::CachedRecord cached;
+      cached.record  = *record;
+      cached.expires = fc::time_point::now() + RecordLifetime;
+      my->_records[name] = cached;
+   }
+   else
+   {
+      // unregistered (or expired) since it was cached
+      my->_records.erase( name );
+   }
+   return record;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <bts/application.hpp>
+#include <memory>
+#include <string>
+
+namespace Detail { class NameRegistryCacheImpl; }
+
+/**
+ *  Remembers recently confirmed Keyhotee ID registrations so repeated
+ *  lookups of the same ID (reputation refreshes, re-validating a contact)
+ *  skip the network round trip.
+ *
+ *  Only registered names are cached.  bts does not expose a feed of the name
+ *  chain, so nothing here can prove a name is free; "not found" always comes
+ *  from lookup_name().
+ */
+class NameRegistryCache
+{
+  public:
+     static NameRegistryCache& instance();
+
+     ~NameRegistryCache();
+
+     /** drops every cached record, ie: when the profile changes */
+     void clear();
+
+     /**
+      *  Drop-in replacement for bts::application::lookup_name that answers
+      *  from the cache while a confirmed record is fresh.
+      */
+     fc::optional<bts::bitname::name_record> lookupName( const std::string& name );
+
+  private:
+     NameRegistryCache();
+
+     std::unique_ptr<Detail::NameRegistryCacheImpl> my;
+};
@@ -0,0 +1,134 @@
+#include "PerfHud.hpp"
+#include "FcEventLoopBridge.hpp"
+
+#include <fc/thread/thread.hpp>
+
+#include <QHeaderView>
+#include <QTreeWidget>
+
+#include <algorithm>
+
+namespace
+{
+   const int RefreshIntervalMs = 500;
+   const int ProbeIntervalMs   = 100;
+
+   const std::string HitsSuffix   = ".hits";
+   const std::string MissesSuffix = ".misses";
+
+   bool endsWith( const std::string& name, const std::string& suffix )
+   {
+      return name.size() >= suffix.size() && name.compare( name.size() - suffix.size(), suffix.size(), suffix ) == 0;
+   }
+}
+
+PerfHud::PerfHud( QWidget* parent )
+:QDockWidget( tr("Performance"), parent )
+{
+   setObjectName( "PerfHud" );
+   _table = new QTreeWidget( this );
+   _table->setRootIsDecorated( false );
+   _table->setColumnCount( 3 );
+   _table->setHeaderLabels( QStringList() << tr("Metric") << tr("Value") << tr("Per second") );
+   _table->header()->setStretchLastSection( false );
+   _table->setUniformRowHeights( true );
+   setWidget( _table );
+
+   _refresh_timer.setInterval( RefreshIntervalMs );
+   connect( &_refresh_timer, &QTimer::timeout, [=](){ refresh(); } );
+   _qt_probe_timer.setInterval( ProbeIntervalMs );
+   connect( &_qt_probe_timer, &QTimer::timeout, [=](){ probeQtLoop(); probeFcLoop(); } );
+   _fc_probe_pending = std::make_shared<bool>( false );
+}
+
+PerfHud::~PerfHud()
+{
+}
+
+void PerfHud::showEvent( QShowEvent* show_event )
+{
+   _refresh_clock.start();
+   _qt_probe_clock.start();
+   _refresh_timer.start();
+   _qt_probe_timer.start();
+   refresh();
+   QDockWidget::showEvent( show_event );
+}
+
+void PerfHud::hideEvent( QHideEvent* hide_event )
+{
+   _refresh_timer.stop();
+   _qt_probe_timer.stop();
+   QDockWidget::hideEvent( hide_event );
+}
+
+void PerfHud::probeQtLoop()
+{
+   static Metric& latency = MetricsRegistry::instance().gauge( "qt.loop_latency_us" );
+   qint64 late_us = _qt_probe_clock.nsecsElapsed() / 1000 - ProbeIntervalMs * 1000;
+   latency.set( std::max<qint64>( 0, late_us ) );
+   _qt_probe_clock.restart();
+}
+
+void PerfHud::probeFcLoop()
+{
+   // a short task per probe, a task sleeping in a loop would keep the bridge polling
+   if( *_fc_probe_pending )
+      return;
+   *_fc_probe_pending = true;
+   auto pending = _fc_probe_pending;
+   auto posted  = fc::time_point::now();
+   FcEventLoopBridge::async( [pending, posted](){
+      static Metric& latency = MetricsRegistry::instance().gauge( "fc.loop_latency_us" );
+      latency.set( (fc::time_point::now() - posted).count() );
+      *pending = false;
+   } );
+}
+
+void PerfHud::refresh()
+{
+   double seconds = std::max<qint64>( 1, _refresh_clock.restart() ) / 1000.0;
+   auto   samples = MetricsRegistry::instance().snapshot();
+
+   std::map<std::string, int64_t> deltas;
+   for( auto itr = samples.begin(); itr != samples.end(); ++itr )
+   {
+      if( itr->kind == Metric::Counter )
+      {
+         auto last = _last_values.find( itr->name );
+         deltas[itr->name] = last == _last_values.end() ? 0 : itr->value - last->second;
+         _last_values[itr->name] = itr->value;
+      }
+   }
+
+   _table->setUpdatesEnabled( false );
+   _table->clear();
+   for( auto itr = samples.begin(); itr != samples.end(); ++itr )
+   {
+      QStringList columns;
+      columns << QString::fromStdString( itr->name ) << QString::number( itr->value );
+      if( itr->kind == Metric::Counter )
+         columns << QString::number( deltas[itr->name] / seconds, 'f', 1 );
+      new QTreeWidgetItem( _table, columns );
+
+      if( itr->kind == Metric::Counter && endsWith( itr->name, HitsSuffix ) )
+      {
+         std::string prefix      = itr->name.substr( 0, itr->name.size() - HitsSuffix.size() );
+         auto        misses      = _last_values.find( prefix + MissesSuffix );
+         int64_t     miss_total  = misses == _last_values.end() ? 0 : misses->second;
+         int64_t     hits_delta  = deltas[itr->name];
+         int64_t     miss_delta  = deltas[prefix + MissesSuffix];
+         // the rate over the last interval, or since start when nothing happened in it
+         int64_t     hits        = hits_delta + miss_delta ? hits_delta : itr->value;
+         int64_t     lookups     = hits_delta + miss_delta ? hits_delta + miss_delta : itr->value + miss_total;
+         QString     hit_rate    = lookups ? QString( "%1%" ).arg( 100.0 * hits / lookups, 0, 'f', 1 ) : QString( "-" );
+         new QTreeWidgetItem( _table, QStringList() << QString::fromStdString( prefix + ".hit_rate" ) << hit_rate );
+      }
+   }
+   _table->resizeColumnToContents( 0 );
+   _table->setUpdatesEnabled( true );
+
+   // maxima are per refresh interval
+   static Metric& frame_max = MetricsRegistry::instance().gauge( "gui.frame_us_max" );
+   frame_max.set( 0 );
+}
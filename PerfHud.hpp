@@ -0,0 +1,45 @@
+#pragma once
+#include "MetricsRegistry.hpp"
+
+#include <QDockWidget>
+#include <QElapsedTimer>
+#include <QTimer>
+
+#include <map>
+#include <memory>
+#include <string>
+
+class QTreeWidget;
+
+/**
+ *  Dock showing what MetricsRegistry holds, refreshed twice a second.
+ *
+ *  Counters are shown with their rate, "x.hits" / "x.misses" pairs also get
+ *  a hit rate row.  While the dock is visible it probes how late a Qt timer
+ *  fires and how long a task posted to fc waits to run, publishing
+ *  qt.loop_latency_us and fc.loop_latency_us; nothing runs while it is hidden.
+ */
+class PerfHud : public QDockWidget
+{
+  public:
+     PerfHud( QWidget* parent = nullptr );
+     ~PerfHud();
+
+  protected:
+     virtual void showEvent( QShowEvent* show_event );
+     virtual void hideEvent( QHideEvent* hide_event );
+
+  private:
+     void refresh();
+     void probeQtLoop();
+     void probeFcLoop();
+
+     QTreeWidget*                     _table;
+     QTimer                           _refresh_timer;
+     QTimer                           _qt_probe_timer;
+     QElapsedTimer                    _qt_probe_clock;
+     QElapsedTimer                    _refresh_clock;
+     std::map<std::string, int64_t>   _last_values;
+     /// set while a probe task is queued, shared with it as it may run after the dock is gone
+     std::shared_ptr<bool>            _fc_probe_pending;
+};
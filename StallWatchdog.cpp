@@ -0,0 +1,242 @@
+#include "StallWatchdog.hpp"
+#include "FcEventLoopBridge.hpp"
+
+#include <fc/thread/thread.hpp>
+#include <fc/log/logger.hpp>
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+#ifndef WIN32
+#include <cxxabi.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#endif
+
+namespace
+{
+   const qint64 MaxLogSize   = 1024*1024;
+   const int    MaxLogFiles  = 3;
+   const int    MaxFrames    = 64;
+
+   int64_t nowMs()
+   {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch() ).count();
+   }
+
+#ifndef WIN32
+   const int StackSignal = SIGUSR2;
+
+   pthread_t              gGuiThread;
+   void*                  gFrames[MaxFrames];
+   volatile sig_atomic_t  gFrameCount = 0;
+   std::atomic<bool>      gStackReady(false);
+
+   void captureStackHandler( int )
+   {
+      gFrameCount = backtrace( gFrames, MaxFrames );
+      gStackReady = true;
+   }
+
+   /** turns "module(mangled+0x1f) [0x...]" into "module: demangled+0x1f" */
+   std::string demangleFrame( const char* symbol )
+   {
+      std::string frame( symbol );
+      size_t open  = frame.find( '(' );
+      size_t plus  = frame.find( '+', open );
+      if( open == std::string::npos || plus == std::string::npos || plus == open + 1 )
+         return frame;
+
+      std::string mangled = frame.substr( open + 1, plus - open - 1 );
+      int status = 0;
+      char* demangled = abi::__cxa_demangle( mangled.c_str(), nullptr, nullptr, &status );
+      if( status != 0 || !demangled )
+         return frame;
+      std::string result = frame.substr( 0, open ) + ": " + demangled + frame.substr( plus, frame.find( ')', plus ) - plus );
+      free( demangled );
+      return result;
+   }
+#endif
+}
+
+StallWatchdog::StallWatchdog( const QString& log_dir, int threshold_ms )
+:_threshold_ms(threshold_ms),
+ _qt_heartbeat(nowMs()),
+ _stopping(false)
+{
+   QDir().mkpath( log_dir );
+   _log_path = QDir(log_dir).filePath( "stalls.log" );
+
+#ifndef WIN32
+   gGuiThread = pthread_self();
+   // the first backtrace() call may allocate while loading libgcc, get it out of the way
+   // here rather than inside the signal handler
+   void* warmup[1];
+   backtrace( warmup, 1 );
+
+   struct sigaction action;
+   memset( &action, 0, sizeof(action) );
+   action.sa_handler = &captureStackHandler;
+   action.sa_flags   = SA_RESTART;
+   sigemptyset( &action.sa_mask );
+   sigaction( StackSignal, &action, nullptr );
+#endif
+
+   _qt_heartbeat_timer.setInterval( std::max( 1, _threshold_ms / 4 ) );
+   QObject::connect( &_qt_heartbeat_timer, &QTimer::timeout, [=](){
+      _qt_heartbeat = nowMs();
+      postFcHeartbeat();
+   } );
+}
+
+StallWatchdog::~StallWatchdog()
+{
+   stop();
+}
+
+void StallWatchdog::start()
+{
+   if( _thread )
+      return;
+   _stopping = false;
+   _qt_heartbeat = nowMs();
+   _qt_heartbeat_timer.start();
+
+   _fc_heartbeat = std::make_shared<FcHeartbeat>();
+   _fc_heartbeat->posted = 0;
+
+   _thread.reset( new std::thread( [=](){ watch(); } ) );
+   ilog( "stall watchdog started, threshold ${t} ms, log ${l}", ("t",_threshold_ms)("l",_log_path.toStdString()) );
+}
+
+void StallWatchdog::stop()
+{
+   if( !_thread )
+      return;
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopping = true;
+   }
+   _wakeup.notify_all();
+   _thread->join();
+   _thread.reset();
+   _fc_heartbeat.reset();
+   _qt_heartbeat_timer.stop();
+}
+
+void StallWatchdog::postFcHeartbeat()
+{
+   // one short task at a time, a task sleeping in a loop would keep the bridge polling
+   auto fc_heartbeat = _fc_heartbeat;
+   if( !fc_heartbeat || fc_heartbeat->posted )
+      return;
+   fc_heartbeat->posted = nowMs();
+   FcEventLoopBridge::async( [fc_heartbeat](){ fc_heartbeat->posted = 0; } );
+}
+
+void StallWatchdog::watch()
+{
+   bool        qt_stalled = false, fc_stalled = false;
+   int64_t     qt_stall_start = 0, fc_stall_start = 0;
+   std::string qt_stack, fc_stack;
+   int         interval_ms = std::max( 1, _threshold_ms / 4 );
+
+   std::unique_lock<std::mutex> lock(_mutex);
+   while( !_stopping )
+   {
+      _wakeup.wait_for( lock, std::chrono::milliseconds( interval_ms ) );
+      if( _stopping )
+         break;
+
+      int64_t now = nowMs();
+      checkLoop( "qt", _qt_heartbeat, now, qt_stalled, qt_stall_start, qt_stack );
+      // fc is only behind while the task posted to it waits
+      int64_t fc_posted = _fc_heartbeat->posted;
+      checkLoop( "fc", fc_posted ? fc_posted : now, now, fc_stalled, fc_stall_start, fc_stack );
+   }
+}
+
+void StallWatchdog::checkLoop( const char* loop_name, int64_t heartbeat, int64_t now,
+                               bool& stalled, int64_t& stall_start, std::string& stack )
+{
+   if( !stalled )
+   {
+      if( now - heartbeat > _threshold_ms )
+      {
+         // sample once per stall, while the GUI thread is still stuck in the culprit
+         stalled     = true;
+         stall_start = heartbeat;
+         stack       = captureGuiStack();
+      }
+   }
+   else if( now - heartbeat <= _threshold_ms )
+   {
+      stalled = false;
+      writeStall( loop_name, heartbeat - stall_start, stack );
+   }
+}
+
+std::string StallWatchdog::captureGuiStack()
+{
+#ifndef WIN32
+   gStackReady = false;
+   if( pthread_kill( gGuiThread, StackSignal ) != 0 )
+      return "<unable to signal GUI thread>";
+
+   for( int i = 0; i < 100 && !gStackReady; ++i )
+      std::this_thread::sleep_for( std::chrono::milliseconds(1) );
+   if( !gStackReady )
+      return "<GUI thread did not respond>";
+
+   std::ostringstream out;
+   int    frame_count = gFrameCount;
+   char** symbols     = backtrace_symbols( gFrames, frame_count );
+   // frame 0 is the signal handler, 1 the signal trampoline
+   for( int i = 2; i < frame_count; ++i )
+   {
+      out << "    #" << (i - 2) << " " << (symbols ? demangleFrame( symbols[i] ) : std::string("?")) << "\n";
+   }
+   free( symbols );
+   return out.str();
+#else
+   return "<stack capture not supported on this platform>";
+#endif
+}
+
+void StallWatchdog::writeStall( const char* loop_name, int64_t duration_ms, const std::string& stack )
+{
+   rotateLog();
+   QFile log_file( _log_path );
+   if( !log_file.open( QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text ) )
+      return;
+
+   QString header = QString( "%1 %2 loop stalled for %3 ms\n" )
+                       .arg( QDateTime::currentDateTime().toString( Qt::ISODate ) )
+                       .arg( loop_name )
+                       .arg( duration_ms );
+   log_file.write( header.toUtf8() );
+   log_file.write( stack.c_str(), stack.size() );
+   log_file.write( "\n" );
+}
+
+void StallWatchdog::rotateLog()
+{
+   if( QFileInfo( _log_path ).size() < MaxLogSize )
+      return;
+   QFile::remove( _log_path + QString( ".%1" ).arg( MaxLogFiles - 1 ) );
+   for( int i = MaxLogFiles - 2; i >= 1; --i )
+   {
+      QFile::rename( _log_path + QString( ".%1" ).arg( i ), _log_path + QString( ".%1" ).arg( i + 1 ) );
+   }
+   QFile::rename( _log_path, _log_path + ".1" );
+}
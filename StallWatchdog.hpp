@@ -0,0 +1,57 @@
+#pragma once
+#include <QString>
+#include <QTimer>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ *  Optional watchdog that detects GUI freezes.
+ *
+ *  A Qt timer bumps a heartbeat and posts a short task to the fc scheduler;
+ *  a separate thread checks that the heartbeat keeps moving and that the fc
+ *  task doesn't wait to run, and when either is stuck for longer than the
+ *  threshold captures a symbolized stack of the GUI thread.  Each stall is
+ *  appended to a rotating log (stalls.log, .1, .2) once the loop recovers,
+ *  with its duration, the loop that stalled and the captured stack.
+ */
+class StallWatchdog
+{
+  public:
+     /** must be constructed on the GUI thread, that is the thread it samples */
+     StallWatchdog( const QString& log_dir, int threshold_ms = 200 );
+     ~StallWatchdog();
+
+     void start();
+     void stop();
+
+  private:
+     void        watch();
+     void        checkLoop( const char* loop_name, int64_t heartbeat, int64_t now,
+                            bool& stalled, int64_t& stall_start, std::string& stack );
+     std::string captureGuiStack();
+     void        writeStall( const char* loop_name, int64_t duration_ms, const std::string& stack );
+     void        rotateLog();
+
+     QString                  _log_path;
+     int                      _threshold_ms;
+     QTimer                   _qt_heartbeat_timer;
+     std::atomic<int64_t>     _qt_heartbeat;
+     std::atomic<bool>        _stopping;
+
+     void        postFcHeartbeat();
+
+     /// shared with the fc heartbeat task, which may outlive a stop()
+     struct FcHeartbeat
+     {
+        /// when the queued heartbeat task was posted, 0 once it has run
+        std::atomic<int64_t>  posted;
+     };
+     std::shared_ptr<FcHeartbeat> _fc_heartbeat;
+     std::unique_ptr<std::thread> _thread;
+     std::mutex               _mutex;
+     std::condition_variable  _wakeup;
+};
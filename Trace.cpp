@@ -0,0 +1,160 @@
+#include "Trace.hpp"
+
+#include <fc/log/logger.hpp>
+
+#ifdef KEYHOTEE_TRACING
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+   /// spans kept per thread, older ones are overwritten
+   const uint32_t RingSize = 1 << 16;
+
+   struct Span
+   {
+      const char* name;
+      uint64_t    start_usec;
+      uint64_t    duration_usec;
+   };
+
+   /** written only by its own thread, read by stop() once recording is off */
+   struct ThreadBuffer
+   {
+      ThreadBuffer( uint32_t thread_id )
+      :id(thread_id),spans(RingSize),count(0){}
+
+      uint32_t              id;
+      std::string           name;
+      std::vector<Span>     spans;
+      std::atomic<uint64_t> count;
+   };
+
+   std::atomic<bool>                           gEnabled(false);
+   std::string                                 gOutputFile;
+   std::mutex                                  gBuffersMutex;
+   /// buffers outlive their threads so spans of finished threads still get dumped
+   std::vector< std::unique_ptr<ThreadBuffer> > gBuffers;
+   thread_local ThreadBuffer*                  tlsBuffer = nullptr;
+
+   ThreadBuffer& threadBuffer()
+   {
+      if( !tlsBuffer )
+      {
+         std::lock_guard<std::mutex> lock( gBuffersMutex );
+         gBuffers.emplace_back( new ThreadBuffer( gBuffers.size() ) );
+         tlsBuffer = gBuffers.back().get();
+      }
+      return *tlsBuffer;
+   }
+
+   void writeJsonString( std::ostream& out, const std::string& str )
+   {
+      out << '"';
+      for( auto c : str )
+      {
+         if( c == '"' || c == '\\' )
+            out << '\\' << c;
+         else if( (unsigned char)c >= 0x20 )
+            out << c;
+      }
+      out << '"';
+   }
+}
+
+namespace Trace
+{
+   bool isEnabled()
+   {
+      return gEnabled.load( std::memory_order_relaxed );
+   }
+
+   uint64_t nowUsec()
+   {
+      return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch() ).count();
+   }
+
+   void record( const char* name, uint64_t start_usec, uint64_t end_usec )
+   {
+      ThreadBuffer& buffer = threadBuffer();
+      uint64_t index = buffer.count.load( std::memory_order_relaxed );
+      Span& span = buffer.spans[index % RingSize];
+      span.name          = name;
+      span.start_usec    = start_usec;
+      span.duration_usec = end_usec - start_usec;
+      buffer.count.store( index + 1, std::memory_order_release );
+   }
+
+   void setThreadName( const char* name )
+   {
+      threadBuffer().name = name;
+   }
+
+   void start( const std::string& output_file )
+   {
+      gOutputFile = output_file;
+      gEnabled = true;
+      ilog( "tracing to ${f}", ("f",output_file) );
+   }
+
+   void stop()
+   {
+      if( !gEnabled.exchange(false) )
+         return;
+
+      std::ofstream out( gOutputFile.c_str() );
+      if( !out )
+      {
+         elog( "unable to write trace file ${f}", ("f",gOutputFile) );
+         return;
+      }
+
+      std::lock_guard<std::mutex> lock( gBuffersMutex );
+      out << "{\"traceEvents\":[\n";
+      bool first = true;
+      for( auto itr = gBuffers.begin(); itr != gBuffers.end(); ++itr )
+      {
+         const ThreadBuffer& buffer = **itr;
+         std::string thread_name = buffer.name.empty() ? "thread " + std::to_string( buffer.id ) : buffer.name;
+         out << (first ? "" : ",\n")
+             << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer.id << ",\"args\":{\"name\":";
+         writeJsonString( out, thread_name );
+         out << "}}";
+         first = false;
+
+         uint64_t count = buffer.count.load( std::memory_order_acquire );
+         uint64_t begin = count > RingSize ? count - RingSize : 0;
+         for( uint64_t i = begin; i < count; ++i )
+         {
+            const Span& span = buffer.spans[i % RingSize];
+            out << ",\n{\"name\":";
+            writeJsonString( out, span.name );
+            out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.id
+                << ",\"ts\":" << span.start_usec << ",\"dur\":" << span.duration_usec << "}";
+         }
+      }
+      out << "\n]}\n";
+      ilog( "trace written to ${f}", ("f",gOutputFile) );
+   }
+}
+
+#else
+
+namespace Trace
+{
+   void start( const std::string& /*output_file*/ )
+   {
+      wlog( "this build has no tracing support, configure with -DKEYHOTEE_TRACING=ON" );
+   }
+
+   void stop()
+   {
+   }
+}
+
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+
+#include <stdint.h>
+
+/**
+ *  Scoped span tracing for startup and interaction timing.
+ *
+ *  KH_TRACE_SCOPE("name") records the time spent in the enclosing scope into a
+ *  ring buffer owned by the calling thread, no locks are taken on the hot path
+ *  and a disabled tracer costs one load.  Trace::stop() dumps every span in the
+ *  Chrome trace event format (load it in chrome://tracing or Perfetto).
+ *
+ *  Everything but start() / stop() compiles away unless the build defines
+ *  KEYHOTEE_TRACING (cmake -DKEYHOTEE_TRACING=ON).
+ *
+ *  Span names must be string literals, only the pointer is stored.  fc fibers
+ *  share their OS thread, spans of fibers that yield inside a scope therefore
+ *  show up overlapping on that thread's track.
+ */
+namespace Trace
+{
+   /** enables recording, the spans are written to output_file by stop() */
+   void start( const std::string& output_file );
+   /** disables recording and writes the trace file */
+   void stop();
+
+#ifdef KEYHOTEE_TRACING
+   bool     isEnabled();
+   uint64_t nowUsec();
+   void     record( const char* name, uint64_t start_usec, uint64_t end_usec );
+   /** names the calling thread's track, defaults to "thread <n>" */
+   void     setThreadName( const char* name );
+
+   class Scope
+   {
+      public:
+         explicit Scope( const char* name )
+         :_name(name),_enabled(isEnabled()),_start(_enabled ? nowUsec() : 0){}
+         ~Scope()
+         {
+            if( _enabled )
+               record( _name, _start, nowUsec() );
+         }
+
+      private:
+         const char* _name;
+         bool        _enabled;
+         uint64_t    _start;
+   };
+#else
+   inline void setThreadName( const char* ) {}
+#endif
+}
+
+#ifdef KEYHOTEE_TRACING
+#define KH_TRACE_CONCAT_IMPL( a, b ) a##b
+#define KH_TRACE_CONCAT( a, b ) KH_TRACE_CONCAT_IMPL( a, b )
+#define KH_TRACE_SCOPE( name ) Trace::Scope KH_TRACE_CONCAT( kh_trace_scope_, __LINE__ )( name )
+#else
+#define KH_TRACE_SCOPE( name ) do {} while( 0 )
+#endif
@@ -9,43 +9,182 @@
 #include <fc/thread/thread.hpp>
 #include <fc/io/fstream.hpp>
 #include <fc/io/json.hpp>
+#include <fc/io/raw.hpp>
 #include <fc/log/logger.hpp>
 #include <fc/reflect/variant.hpp>
 
 #include "profile_wizard/ProfileWizard.hpp"
 #include "LoginDialog.hpp"
 #include "KeyhoteeMainWindow.hpp"
+#include "AddressBook/ChatTranscript.hpp"
+#include "FcEventLoopBridge.hpp"
+#include "StallWatchdog.hpp"
+#include "MiningScheduler.hpp"
+#include "LoadGenerator.hpp"
+#include "EventJournal.hpp"
+#include "JournalReplayer.hpp"
+#include "Trace.hpp"
+#include "AsyncLog.hpp"
 
 #include <QApplication>
 #include <QStandardPaths>
-#include <QTimer>
 
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
 #include <QFile>
-#include <QDebug>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 
 std::string gApplication_name = "Keyhotee";
 std::string gProfile_name = "default";
+/// number of fake contacts for --loadgen, 0 when not load testing
+int         gLoadgen_contacts = 0;
+/// journal to feed back into the main window (--replay), empty otherwise
+std::string gReplay_journal;
+bool        gReplay_fast = false;
+
+
+namespace
+{
+   const quint32 ConfigSnapshotMagic   = 0x4b484346; // "KHCF"
+   const quint32 ConfigSnapshotVersion = 1;
+
+   QByteArray sha256( const QByteArray& data )
+   {
+      return QCryptographicHash::hash( data, QCryptographicHash::Sha256 );
+   }
+
+   /// --loadgen and --replay write into the profile, they only run against profiles named like this
+   const char ScratchProfilePrefix[] = "scratch";
+
+   bool is_scratch_profile( const std::string& profile_name )
+   {
+      return profile_name.compare( 0, strlen( ScratchProfilePrefix ), ScratchProfilePrefix ) == 0;
+   }
+
+   bool write_file_atomically( const QString& file_name, const QByteArray& data )
+   {
+      QSaveFile file( file_name );
+      if( !file.open( QIODevice::WriteOnly ) || file.write( data ) != data.size() )
+         return false;
+      return file.commit();
+   }
+
+   /**
+    *  Fingerprint of application_config's fields: their names and order as
+    *  the defaults serialize them.  fc::raw carries no field names, a snapshot
+    *  packed by a bts with a different layout would be misread.
+    */
+   QByteArray config_layout_hash()
+   {
+      static QByteArray layout_hash;
+      if( layout_hash.isEmpty() )
+      {
+         std::string default_json = fc::json::to_pretty_string( bts::application_config() );
+         layout_hash = sha256( QByteArray( default_json.c_str(), default_json.size() ) );
+      }
+      return layout_hash;
+   }
+
+   /**
+    *  config.bin holds the fc::raw packed config together with the hash of the
+    *  config.json it was built from and the config layout it was packed with,
+    *  it is only used while both match.
+    */
+   fc::optional<bts::application_config> read_config_snapshot( const QString& snapshot_file, const QByteArray& json_hash )
+   {
+      QFile file( snapshot_file );
+      if( !file.open( QIODevice::ReadOnly ) )
+         return fc::optional<bts::application_config>();
 
+      QDataStream in( &file );
+      quint32    magic = 0, version = 0;
+      QByteArray snapshot_json_hash, layout_hash, payload_hash, payload;
+      in >> magic >> version >> snapshot_json_hash >> layout_hash >> payload_hash >> payload;
+      if( in.status() != QDataStream::Ok || magic != ConfigSnapshotMagic || version != ConfigSnapshotVersion ||
+          snapshot_json_hash != json_hash || layout_hash != config_layout_hash() || payload_hash != sha256( payload ) )
+      {
+         return fc::optional<bts::application_config>();
+      }
+
+      try {
+         std::vector<char> data( payload.begin(), payload.end() );
+         return fc::raw::unpack<bts::application_config>( data );
+      }
+      catch ( const fc::exception& e )
+      {
+         wlog( "ignoring unreadable config snapshot: ${e}", ("e",e.to_detail_string()) );
+      }
+      return fc::optional<bts::application_config>();
+   }
+
+   void write_config_snapshot( const QString& snapshot_file, const QByteArray& json_hash, const bts::application_config& app_config )
+   {
+      std::vector<char> data = fc::raw::pack( app_config );
+      QByteArray payload( data.data(), data.size() );
 
+      QByteArray snapshot;
+      QDataStream out( &snapshot, QIODevice::WriteOnly );
+      out << ConfigSnapshotMagic << ConfigSnapshotVersion << json_hash << config_layout_hash() << sha256( payload ) << payload;
+      if( !write_file_atomically( snapshot_file, snapshot ) )
+      {
+         wlog( "unable to write config snapshot ${f}", ("f",snapshot_file.toStdString()) );
+      }
+   }
+}
+
+/**
+ *  Loading never writes unless it has to: config.json is only (re)written when
+ *  it is missing or lacks fields the current application_config has, and the
+ *  parsed result is cached in config.bin for the next start.
+ */
 bts::application_config load_config( const std::string& profile_name )
 { try {
+     KH_TRACE_SCOPE( "load_config" );
      auto qdatadir     = QStandardPaths::writableLocation( QStandardPaths::DataLocation );
      auto data_dir     = fc::path( qdatadir.toStdString() ) / profile_name;
      fc::create_directories(data_dir);
-     auto config_file  = data_dir / "config.json";
+     auto config_file   = data_dir / "config.json";
+     auto json_file     = QString::fromStdString( config_file.generic_string() );
+     auto snapshot_file = QString::fromStdString( (data_dir / "config.bin").generic_string() );
      ilog( "config_file: ${file}", ("file",config_file) );
      if( !fc::exists( config_file ) )
      {
         bts::application_config default_cfg;
         default_cfg.data_dir = data_dir / "data";
 
-        fc::ofstream out( config_file );
-        out << fc::json::to_pretty_string( default_cfg );
+        std::string default_json = fc::json::to_pretty_string( default_cfg );
+        if( !write_file_atomically( json_file, QByteArray( default_json.c_str(), default_json.size() ) ) )
+           FC_THROW_EXCEPTION( fc::file_not_found_exception, "unable to write ${file}", ("file",config_file) );
      }
 
-     auto app_config = fc::json::from_file( config_file ).as<bts::application_config>();
-     fc::ofstream out( config_file );
-     out << fc::json::to_pretty_string( app_config );
+     QFile json( json_file );
+     if( !json.open( QIODevice::ReadOnly ) )
+        FC_THROW_EXCEPTION( fc::file_not_found_exception, "unable to read ${file}", ("file",config_file) );
+     QByteArray json_data = json.readAll();
+     QByteArray json_hash = sha256( json_data );
+
+     // after a bts upgrade the layout no longer matches, the json below fills in the new fields
+     auto cached_config = read_config_snapshot( snapshot_file, json_hash );
+     if( cached_config )
+        return *cached_config;
+
+     auto app_config = fc::json::from_string( std::string( json_data.constData(), json_data.size() ) ).as<bts::application_config>();
+     std::string normalized_json = fc::json::to_pretty_string( app_config );
+     QByteArray  normalized( normalized_json.c_str(), normalized_json.size() );
+     if( normalized != json_data )
+     {
+        // fill in fields added since the file was written, leave it alone otherwise
+        if( write_file_atomically( json_file, normalized ) )
+           json_hash = sha256( normalized );
+     }
+     write_config_snapshot( snapshot_file, json_hash, app_config );
      return app_config;
 } FC_RETHROW_EXCEPTIONS( warn, "") }
 
@@ -55,9 +194,15 @@ void display_login();
 
 void startup( const std::string& profile_name )
 {
+   KH_TRACE_SCOPE( "startup" );
    auto btsapp     = bts::application::instance();
    auto app_config = load_config( profile_name );
-   btsapp->configure( app_config );
+   {
+      KH_TRACE_SCOPE( "configure" );
+      btsapp->configure( app_config );
+   }
+   ChatTranscript::setStorageDirectory( QString::fromStdString( (app_config.data_dir / "chat").generic_string() ) );
+   MiningScheduler::setStateFile( app_config.data_dir / "mining_state.json" );
 
    if( btsapp->has_profile() )
    {
@@ -79,32 +224,126 @@ int main( int argc, char** argv )
   fprintf(stderr,"testing stderr\n");
   #endif
   try {
+     for( int i = 1; i < argc; ++i )
+     {
+        // replay runs headless unless the platform was chosen explicitly
+        if( strncmp( argv[i], "--replay=", 9 ) == 0 && qgetenv( "QT_QPA_PLATFORM" ).isEmpty() )
+           qputenv( "QT_QPA_PLATFORM", "offscreen" );
+     }
      QApplication app(argc,argv); 
 
      app.setOrganizationDomain( "invictus-innovations.com" );
      app.setOrganizationName( "Invictus Innovations, Inc" );
 
-     QFile file(":/index.htm");
-     QByteArray dump = file.readAll();
-     qDebug() << "contents: " << dump;
-     qDebug() << "error status: " << file.error();
+     int         watchdog_threshold_ms = 0;
+     std::string trace_file;
+     std::string record_file;
+     for( int i = 1; i < argc; ++i )
+     {
+        std::string arg( argv[i] );
+        if( arg == "--watchdog" )
+        {
+           watchdog_threshold_ms = 200;
+        }
+        else if( arg.compare( 0, 11, "--watchdog=" ) == 0 )
+        {
+           watchdog_threshold_ms = std::max( 1, atoi( arg.c_str() + 11 ) );
+        }
+        else if( arg == "--loadgen" )
+        {
+           gLoadgen_contacts = LoadGenerator::Options().contacts;
+        }
+        else if( arg.compare( 0, 10, "--loadgen=" ) == 0 )
+        {
+           gLoadgen_contacts = std::max( 1, atoi( arg.c_str() + 10 ) );
+        }
+        else if( arg.compare( 0, 8, "--trace=" ) == 0 )
+        {
+           trace_file = arg.substr( 8 );
+        }
+        else if( arg.compare( 0, 9, "--record=" ) == 0 )
+        {
+           record_file = arg.substr( 9 );
+        }
+        else if( arg.compare( 0, 9, "--replay=" ) == 0 )
+        {
+           gReplay_journal = arg.substr( 9 );
+           auto comma = gReplay_journal.rfind( ',' );
+           if( comma != std::string::npos && gReplay_journal.substr( comma ) == ",fast" )
+           {
+              gReplay_fast = true;
+              gReplay_journal.resize( comma );
+           }
+        }
+        else if( arg.compare( 0, 2, "--" ) == 0 )
+        {
+           // a mistyped option would otherwise create and open a profile of that name
+           fprintf( stderr, "unknown option %s\n", arg.c_str() );
+           return 1;
+        }
+        else
+        {
+           gProfile_name = arg;
+        }
+     }
 
-     if( argc > 1 ) 
-     { 
-        gProfile_name = std::string(argv[1]); 
+     if( gLoadgen_contacts && !is_scratch_profile( gProfile_name ) )
+     {
+        fprintf( stderr, "--loadgen stores fake contacts and messages in the profile, "
+                         "give it a profile whose name starts with \"%s\"\n", ScratchProfilePrefix );
+        return 1;
+     }
+     if( !gReplay_journal.empty() && !is_scratch_profile( gProfile_name ) )
+     {
+        fprintf( stderr, "--replay overwrites contacts and adds chat to the profile, "
+                         "give it a profile whose name starts with \"%s\"\n", ScratchProfilePrefix );
+        return 1;
      }
 
      app.setApplicationName( gApplication_name.c_str() );
 
-     fc::async( [=](){ startup( gProfile_name ); } );
+     auto log_dir = QStandardPaths::writableLocation( QStandardPaths::DataLocation ) + "/" + gProfile_name.c_str() + "/logs";
+     QDir().mkpath( log_dir );
+     AsyncLog::start( (log_dir + "/keyhotee.log").toStdString() );
+     if( !gReplay_journal.empty() && trace_file.empty() )
+     {
+        trace_file = (log_dir + "/replay_trace.json").toStdString();
+     }
+     if( !trace_file.empty() )
+     {
+        Trace::setThreadName( "gui" );
+        Trace::start( trace_file );
+     }
 
-     qApp->connect( qApp, &QApplication::aboutToQuit, [=](){ bts::application::instance()->quit(); } );
+     std::unique_ptr<StallWatchdog> watchdog;
+     if( watchdog_threshold_ms )
+     {
+        watchdog.reset( new StallWatchdog( log_dir, watchdog_threshold_ms ) );
+        watchdog->start();
+     }
 
-     QTimer fc_exec;
-     QObject::connect( &fc_exec, &QTimer::timeout, []() { fc::usleep( fc::microseconds(30*1000) ); }  );
-     fc_exec.start(5);
+     if( !record_file.empty() )
+     {
+        EventJournal::instance().startRecording( QString::fromStdString( record_file ) );
+     }
+
+     FcEventLoopBridge::async( [=](){ startup( gProfile_name ); } );
+
+     qApp->connect( qApp, &QApplication::aboutToQuit, [=](){ 
+         EventJournal::instance().stopRecording();
+         bts::application::instance()->quit(); 
+     } );
+
+     FcEventLoopBridge fc_bridge;
+     fc_bridge.start();
 
      int result = app.exec(); 
+     if( watchdog )
+     {
+        watchdog->stop();
+     }
+     Trace::stop();
+     AsyncLog::stop();
      #ifdef WIN32
      fclose(stdout);
      FreeConsole();
@@ -114,6 +353,7 @@ int main( int argc, char** argv )
   catch ( const fc::exception& e )
   {
      elog( "${e}", ("e", e.to_detail_string() ) );
+     AsyncLog::stop();
   }
   return -1;
 }
@@ -128,8 +368,26 @@ void start_profile_creation_wizard( const bts::application_ptr& /*btsapp*/)
 
 void display_main_window()
 {
+  KH_TRACE_SCOPE( "display_main_window" );
   KeyhoteeMainWindow* main_window = GetKeyhoteeWindow();
   main_window->show();
+
+  if( gLoadgen_contacts )
+  {
+     LoadGenerator::Options options;
+     options.contacts    = gLoadgen_contacts;
+     options.report_file = QStandardPaths::writableLocation( QStandardPaths::DataLocation ) + "/" +
+                           gProfile_name.c_str() + "/logs/loadgen.json";
+     QDir().mkpath( QFileInfo( options.report_file ).path() );
+     auto load_generator = new LoadGenerator( *main_window, options, main_window );
+     load_generator->start();
+  }
+
+  if( !gReplay_journal.empty() )
+  {
+     auto replayer = new JournalReplayer( *main_window, QString::fromStdString( gReplay_journal ), gReplay_fast, main_window );
+     replayer->start();
+  }
 }
 
 void display_login()
@@ -141,6 +399,13 @@ void display_login()
                         display_main_window(); 
                     } );
     login_dialog->show();
+
+    // unattended replays, main() made sure the profile is a scratch one
+    QByteArray replay_password = qgetenv( "KEYHOTEE_REPLAY_PASSWORD" );
+    if( !gReplay_journal.empty() && !replay_password.isEmpty() )
+    {
+        login_dialog->login( QString::fromUtf8( replay_password ) );
+    }
 }
 
 
@@ -2,6 +2,8 @@
 #include <ui_ProfileEditPage.h>
 #include <ui_ProfileIntroPage.h>
 #include <ui_ProfileNymPage.h>
+#include "../FcEventLoopBridge.hpp"
+#include "../NameRegistryCache.hpp"
 
 #include <fc/thread/thread.hpp>
 
@@ -33,7 +35,7 @@ class NymPage : public QWizardPage
             completeChanged();
             _last_validate = fc::time_point::now();
             _profile_nym_ui.id_warning->setText( tr( "Checking availability of ID..." ) );
-            fc::async( [=](){ 
+            FcEventLoopBridge::async( [=](){ 
                 fc::usleep( fc::microseconds(500*1000) );
                 if( fc::time_point::now() > (_last_validate + fc::microseconds(500*1000)) )
                 {
@@ -46,7 +48,7 @@ class NymPage : public QWizardPage
         {
             try {
                 auto current_id = _profile_nym_ui.keyhotee_id->text().toStdString();
-                auto opt_name_record = bts::application::instance()->lookup_name( current_id );
+                auto opt_name_record = NameRegistryCache::instance().lookupName( current_id );
                 if( opt_name_record )
                 {
                      _profile_nym_ui.id_warning->setText( tr( "This ID has been taken by another user" ) );